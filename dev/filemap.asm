@@ -58,6 +58,7 @@ PROC_BITMAP_COUNT     = PROC_HANDLE_COUNT SHR 5
   REQ_GROW = 7
   REQ_UPDATE = 8
   REQ_DELETE = 9
+  REQ_RESERVE = 10
 
     .386p
 
@@ -959,12 +960,44 @@ AddWaitReq      Proc near
     ret
 AddWaitReq  Endp
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;       
+;
+;       NAME:           IoSlotFree
+;
+;       DESCRIPTION:    Check write slot of IO ring. Section must be taken!
+;
+;       PARAMETERS:     DS             Part sel
+;
+;       RETURNS:        NC, ZR         ES:ESI is free slot
+;                       NC, NZ         Ring is full
+;                       CY             No IO server
+;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+IoSlotFree  Proc near
+    mov ax,ds:vfsp_io_sel
+    or ax,ax
+    stc
+    jz isfDone
+;
+    mov es,eax
+    movzx esi,ds:vfsp_io_wr_ptr
+    cmp es:[esi].fqe_op,0
+
+isfDone:
+    ret
+IoSlotFree  Endp
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;       
 ;
 ;       NAME:           AddReq
 ;
-;       DESCRIPTION:    Add req
+;       DESCRIPTION:    Add req. When the ring is full, the thread waits
+;                       until the server signals that it freed entries.
+;                       One producer at a time waits, and the others
+;                       block in vfsp_io_full_section.
 ;
 ;       PARAMETERS:     DS             Sys interface
 ;                       EBX            OP
@@ -982,45 +1015,67 @@ AddReq     Proc near
 ;
     mov edi,ds:kf_serv_handle
     mov ds,ds:kf_part_sel
-
-arRetry:
-    EnterSection ds:vfsp_io_section
-;
     push eax
-    mov ax,ds:vfsp_io_sel
-    or ax,ax
-    jz arDone
 ;
-    mov es,eax
-    movzx esi,ds:vfsp_io_wr_ptr
-    mov ax,es:[esi].fqe_op
-    or ax,ax
-    pop eax
+    EnterSection ds:vfsp_io_section
+    call IoSlotFree
+    jc arDone
     jz arRoom
 ;
     LeaveSection ds:vfsp_io_section
+    EnterSection ds:vfsp_io_full_section
+
+arWait:
+    EnterSection ds:vfsp_io_section
+    call IoSlotFree
+    jc arFullDone
+    jz arFullDone
+;
+    GetThread
+    mov ds:vfsp_io_full_thread,ax
+    LeaveSection ds:vfsp_io_section
 ;
-    mov ax,25
-    WaitMilliSec
-    jmp arRetry
- 
+    WaitForSignal
+    jmp arWait
+
+arFullDone:
+    pushf
+    mov ds:vfsp_io_full_thread,0
+    LeaveSection ds:vfsp_io_full_section
+;
+; the wait could have taken a signal meant for the caller, so post it again
+;
+    push ebx
+    GetThread
+    mov bx,ax
+    Signal
+    pop ebx
+;
+    popf
+    jc arDone
+
 arRoom:
+    pop eax
     mov es:[esi].fqe_p64,eax
     mov es:[esi].fqe_p64+4,edx
     mov es:[esi].fqe_p32,ecx
     mov es:[esi].fqe_handle,di
     mov es:[esi].fqe_op,bx
     add si,10h
-    and si,0FFFh
+    and si,ds:vfsp_io_mask
     mov ds:vfsp_io_wr_ptr,si
 ;
     mov bx,ds:vfsp_io_thread
     or bx,bx
-    jz arDone
+    jz arLeave
 ;
     Signal
+    jmp arLeave
 
 arDone:
+    pop eax
+
+arLeave:
     LeaveSection ds:vfsp_io_section
 ;
     pop edi
@@ -4939,6 +4994,40 @@ SetSizeSel    Proc far
     ret
 SetSizeSel    Endp
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;       
+;
+;       NAME:           ReserveSel
+;
+;       DESCRIPTION:    Reserve disc space without changing file size
+;
+;       PARAMETERS:     DS              Handle interface
+;                       EDX:EAX         Size
+;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+ReserveSel    Proc far
+    push ds
+    push ebx
+    push ecx
+;
+    mov ds,ds:hf_file_sel
+    push eax
+    GetThreadHandle
+    movzx ecx,ax
+    pop eax
+;
+    mov ebx,REQ_RESERVE
+    call AddReq
+;
+    WaitForSignal
+;
+    pop ecx
+    pop ebx
+    pop ds
+    ret
+ReserveSel    Endp
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;       
 ;
@@ -5288,6 +5377,9 @@ InitHandleSel   Proc near
 ;
     mov es:hui_set_size_proc, OFFSET SetSizeSel
     mov es:hui_set_size_proc+4,cs
+;
+    mov es:hui_reserve_proc, OFFSET ReserveSel
+    mov es:hui_reserve_proc+4,cs
 ;
     mov es:hui_get_create_time_proc, OFFSET GetCreateSel
     mov es:hui_get_create_time_proc+4,cs
@@ -618,6 +618,9 @@ InitHandleObj  Proc near
 ;
     mov es:hui_set_size_proc,OFFSET handle_fail
     mov es:hui_set_size_proc+4,cs
+;
+    mov es:hui_reserve_proc,OFFSET handle_fail
+    mov es:hui_reserve_proc+4,cs
 ;
     mov es:hui_get_pos_proc,OFFSET handle_fail
     mov es:hui_get_pos_proc+4,cs
@@ -1625,6 +1628,32 @@ shsDone:
     ret
 SetHandleSizeObj     Endp        
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;
+;
+;           NAME:           ReserveHandleObj
+;
+;           DESCRIPTION:    Reserve handle disc space
+;
+;           PARAMETERS:     BX          Handle
+;                           EDX:EAX     Size
+;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+ReserveHandleObj     Proc near
+    push ds
+;
+    call LockInterface
+    jc rhoDone
+;
+    call fword ptr ds:hui_reserve_proc
+    call UnlockInterface
+
+rhoDone:
+    pop ds
+    ret
+ReserveHandleObj     Endp        
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;
 ;
@@ -2356,6 +2385,26 @@ shsDone64:
     ret
 set_handle_size64     Endp        
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;
+;
+;           NAME:           ReserveHandle
+;
+;           DESCRIPTION:    Reserve disc space for handle without changing
+;                           its size
+;
+;           PARAMETERS:     BX          Handle
+;                           EDX:EAX     Size
+;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+reserve_handle64_name  DB 'Reserve Handle 64', 0
+
+reserve_handle64     Proc far
+    call ReserveHandleObj
+    ret
+reserve_handle64     Endp        
+
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;
 ;
@@ -3614,6 +3663,12 @@ init_sys_handle     PROC near
     xor cl,cl
     mov ax,set_handle_size64_nr
     RegisterBimodalUserGate
+;
+    mov esi,OFFSET reserve_handle64
+    mov edi,OFFSET reserve_handle64_name
+    xor cl,cl
+    mov ax,reserve_handle64_nr
+    RegisterBimodalUserGate
 ;
     mov esi,OFFSET get_handle_create_time
     mov edi,OFFSET get_handle_create_time_name
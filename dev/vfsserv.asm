@@ -159,7 +159,10 @@ InitPartSel  Proc near
 ;
     InitSection es:vfsp_req_section
     InitSection es:vfsp_io_section
+    InitSection es:vfsp_io_full_section
     mov es:vfsp_io_sel,0
+    mov es:vfsp_io_full_thread,0
+    mov es:vfsp_io_mask,MIN_VFS_IO_SIZE - 1
 ;
     pop ecx
     ret
@@ -4011,6 +4014,10 @@ FreeBlock  Endp
 ;       PARAMETERS:     EBX         VFS Handle
 ;                       EDX         Buffer
 ;
+;       The first entry of the buffer can give the ring size. If fqe_p64
+;       is VFS_IO_SIGNATURE, fqe_p32 is the number of entries, which must
+;       be a power of two. Otherwise the ring is one page.
+;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
 start_vfs_io_server_name       DB 'Start VFS IO Server',0
@@ -4021,11 +4028,45 @@ start_vfs_io_server    Proc far
     push eax
     push ebx
     push ecx
+    push edx
+    push esi
     push edi
 ;
     call HandleToPartFs
     jc svioDone
 ;
+    mov ax,serv_flat_sel
+    mov es,eax
+    mov ecx,MIN_VFS_IO_SIZE
+    cmp es:[edx].fqe_p64,VFS_IO_SIGNATURE
+    jne svioSize
+;
+    mov eax,es:[edx].fqe_p32
+    shl eax,4
+    cmp eax,ecx
+    jb svioSize
+;
+    cmp eax,MAX_VFS_IO_SIZE
+    ja svioSize
+;
+    mov esi,eax
+    dec esi
+    test eax,esi
+    jnz svioSize
+;
+    mov ecx,eax
+
+svioSize:
+    mov esi,edx
+    mov eax,ecx
+    AllocateBigLinear
+    mov edi,edx
+;
+    push ecx
+    shr ecx,12
+
+svioMap:
+    mov edx,esi
     GetPageEntry
     push eax
     push ebx
@@ -4033,26 +4074,36 @@ start_vfs_io_server    Proc far
     and ax,0F000h
     or ax,867h
     SetPageEntry
-;
-    mov eax,1000h
-    AllocateBigLinear
 ;
     pop ebx
     pop eax
+    mov edx,edi
     SetPageEntry
+;
+    add esi,1000h
+    add edi,1000h
+    loop svioMap
+;
+    pop ecx
+    sub edi,ecx
+    mov edx,edi
 ;
     AllocateGdt
-    mov ecx,1000h
     CreateDataSelector32
     mov fs:vfsp_io_sel,bx
 ;
+    dec ecx
+    mov fs:vfsp_io_mask,cx
     mov fs:vfsp_io_wr_ptr,0
     mov fs:vfsp_io_thread,0
+    mov fs:vfsp_io_full_thread,0
 ;
     clc
 
 svioDone:
     pop edi
+    pop esi
+    pop edx
     pop ecx
     pop ebx
     pop eax
@@ -4071,6 +4122,10 @@ start_vfs_io_server    Endp
 ;       PARAMETERS:     EBX            VFS handle
 ;                       EDX            Current position
 ;
+;       If EDX is VFS_IO_SPACE, the server has freed entries of a full
+;       ring. A producer that waits for room is signalled, and there is
+;       no wait.
+;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
 serv_wait_io_server_name       DB 'Serv Wait Io Server',0
@@ -4084,6 +4139,9 @@ serv_wait_io_server    Proc far
 ;
     call HandleToPartFs
     jc swfqDone
+;
+    cmp edx,VFS_IO_SPACE
+    je swfqSpace
 ;
     ClearSignal
 ;
@@ -4104,6 +4162,21 @@ serv_wait_io_server    Proc far
 
 swfqClear:
     mov ds:vfsp_io_thread,0
+    jmp swfqDone
+
+swfqSpace:
+    mov eax,fs
+    mov ds,eax
+    EnterSection ds:vfsp_io_section
+;
+    xor bx,bx
+    xchg bx,ds:vfsp_io_full_thread
+    LeaveSection ds:vfsp_io_section
+;
+    or bx,bx
+    jz swfqDone
+;
+    Signal
 
 swfqDone:
     pop edx
@@ -4140,6 +4213,14 @@ stop_vfs_io_server    Proc far
     mov ds,eax
     EnterSection ds:vfsp_io_section
 ;
+    xor bx,bx
+    xchg bx,ds:vfsp_io_full_thread
+    or bx,bx
+    jz evioThread
+;
+    Signal
+
+evioThread:
     xor bx,bx
     xchg bx,ds:vfsp_io_thread
     or bx,bx
@@ -4161,10 +4242,15 @@ evioFree:
 ;
     mov es,bx
     GetSelectorBaseSize
-;
+    add ecx,0FFFh
+    shr ecx,12
+
+evioUnmap:
     xor eax,eax
     xor ebx,ebx
     SetPageEntry
+    add edx,1000h
+    loop evioUnmap
 ;
     FreeMem
     clc
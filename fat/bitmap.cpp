@@ -0,0 +1,826 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# bitmap.cpp
+# Free cluster bitmap
+#
+########################################################################*/
+
+#include <memory.h>
+#include "bitmap.h"
+#include "fatkern.h"
+
+int FindFirstBit(unsigned int val);
+#pragma aux FindFirstBit = \
+    "bsf eax,eax" \
+    __parm [__eax] \
+    __value [__eax]
+
+int FindLastBit(unsigned int val);
+#pragma aux FindLastBit = \
+    "bsr eax,eax" \
+    __parm [__eax] \
+    __value [__eax]
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::TFatBitmap
+#
+#   Purpose....: Free cluster bitmap constructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatBitmap::TFatBitmap()
+{
+    FBits = 0;
+    FClusters = 0;
+    FWords = 0;
+    FGroupFree = 0;
+    FGroupLarge = 0;
+    FGroups = 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::~TFatBitmap
+#
+#   Purpose....: Free cluster bitmap destructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatBitmap::~TFatBitmap()
+{
+    Reset();
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::Setup
+#
+#   Purpose....: Allocate bitmap with all clusters marked as used
+#
+#   In params..: Clusters       Number of FAT entries
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::Setup(unsigned int Clusters)
+{
+    Reset();
+
+    FWords = (Clusters + 31) / 32;
+    FGroups = (Clusters + FAT_BITMAP_GROUP_SIZE - 1) >> FAT_BITMAP_GROUP_SHIFT;
+    FBits = new unsigned int[FGroups * FAT_BITMAP_GROUP_SIZE / 32];
+    FGroupFree = new unsigned short int[FGroups];
+    FGroupLarge = new unsigned short int[FGroups];
+
+    if (FBits && FGroupFree && FGroupLarge)
+    {
+        FClusters = Clusters;
+        memset(FBits, 0, FGroups * FAT_BITMAP_GROUP_SIZE / 8);
+        memset(FGroupFree, 0, FGroups * sizeof(unsigned short int));
+        memset(FGroupLarge, 0, FGroups * sizeof(unsigned short int));
+    }
+    else
+        Reset();
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::Reset
+#
+#   Purpose....: Free bitmap
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::Reset()
+{
+    if (FBits)
+        delete FBits;
+
+    if (FGroupFree)
+        delete FGroupFree;
+
+    if (FGroupLarge)
+        delete FGroupLarge;
+
+    FBits = 0;
+    FClusters = 0;
+    FWords = 0;
+    FGroupFree = 0;
+    FGroupLarge = 0;
+    FGroups = 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::IsValid
+#
+#   Purpose....: Check if bitmap is available
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatBitmap::IsValid()
+{
+    if (FBits)
+        return true;
+    else
+        return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::GetGroups
+#
+#   Purpose....: Get number of allocation groups
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatBitmap::GetGroups()
+{
+    return FGroups;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::GetGroupFree
+#
+#   Purpose....: Get free clusters in allocation group
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatBitmap::GetGroupFree(unsigned int Group)
+{
+    if (Group < FGroups)
+        return FGroupFree[Group];
+    else
+        return 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::GetGroupLarge
+#
+#   Purpose....: Get largest free extent inside allocation group. The
+#                value is cached, and is recalculated after clusters in
+#                the group have changed
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: Clusters in largest extent
+#
+##########################################################################*/
+unsigned int TFatBitmap::GetGroupLarge(unsigned int Group)
+{
+    unsigned int Pos;
+    unsigned int End;
+    unsigned int Ext;
+    unsigned int Len;
+    unsigned int Large = 0;
+
+    if (Group >= FGroups || FGroupFree[Group] == 0)
+        return 0;
+
+    if (FGroupLarge[Group] != FAT_BITMAP_LARGE_UNKNOWN)
+        return FGroupLarge[Group];
+
+    Pos = Group << FAT_BITMAP_GROUP_SHIFT;
+    End = Pos + FAT_BITMAP_GROUP_SIZE;
+
+    if (Pos < 2)
+        Pos = 2;
+
+    if (End > FClusters)
+        End = FClusters;
+
+    while (Pos < End)
+    {
+        Ext = Scan(Pos, End);
+        if (!Ext)
+            break;
+
+        Len = ScanUsed(Ext, End) - Ext;
+        if (Len > Large)
+            Large = Len;
+
+        Pos = Ext + Len;
+    }
+
+    FGroupLarge[Group] = (unsigned short int)Large;
+    return Large;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::InvalidateLarge
+#
+#   Purpose....: Mark largest free extent of groups as unknown after
+#                clusters were freed
+#
+#   In params..: Start          First freed cluster
+#                End            First cluster beyond freed range
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::InvalidateLarge(unsigned int Start, unsigned int End)
+{
+    unsigned int Group = Start >> FAT_BITMAP_GROUP_SHIFT;
+    unsigned int Last = (End - 1) >> FAT_BITMAP_GROUP_SHIFT;
+
+    if (Start >= End)
+        return;
+
+    while (Group <= Last && Group < FGroups)
+    {
+        FGroupLarge[Group] = FAT_BITMAP_LARGE_UNKNOWN;
+        Group++;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::IsFree
+#
+#   Purpose....: Check if cluster is free
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatBitmap::IsFree(unsigned int Cluster)
+{
+    if (Cluster < FClusters)
+        if (FBits[Cluster >> 5] & (1 << (Cluster & 0x1F)))
+            return true;
+
+    return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::SetFree
+#
+#   Purpose....: Mark cluster as free
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::SetFree(unsigned int Cluster)
+{
+    unsigned int Mask = 1 << (Cluster & 0x1F);
+
+    if (Cluster >= 2 && Cluster < FClusters)
+    {
+        if ((FBits[Cluster >> 5] & Mask) == 0)
+        {
+            FBits[Cluster >> 5] |= Mask;
+            FGroupFree[Cluster >> FAT_BITMAP_GROUP_SHIFT]++;
+            FGroupLarge[Cluster >> FAT_BITMAP_GROUP_SHIFT] = FAT_BITMAP_LARGE_UNKNOWN;
+        }
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::SetUsed
+#
+#   Purpose....: Mark cluster as used
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::SetUsed(unsigned int Cluster)
+{
+    unsigned int Mask = 1 << (Cluster & 0x1F);
+
+    if (Cluster < FClusters)
+    {
+        if (FBits[Cluster >> 5] & Mask)
+        {
+            FBits[Cluster >> 5] &= ~Mask;
+            FGroupFree[Cluster >> FAT_BITMAP_GROUP_SHIFT]--;
+
+            if (FGroupFree[Cluster >> FAT_BITMAP_GROUP_SHIFT] == 0)
+                FGroupLarge[Cluster >> FAT_BITMAP_GROUP_SHIFT] = 0;
+            else
+                FGroupLarge[Cluster >> FAT_BITMAP_GROUP_SHIFT] = FAT_BITMAP_LARGE_UNKNOWN;
+        }
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::SetFreeRun
+#
+#   Purpose....: Mark a run of clusters as free, a word at a time
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::SetFreeRun(unsigned int Cluster, unsigned int Count)
+{
+    unsigned int End = Cluster + Count;
+    unsigned int Bits;
+    unsigned int Mask;
+    unsigned int New;
+
+    if (Cluster < 2)
+        Cluster = 2;
+
+    if (End > FClusters)
+        End = FClusters;
+
+    InvalidateLarge(Cluster, End);
+
+    while (Cluster < End)
+    {
+        Bits = 32 - (Cluster & 0x1F);
+        if (Bits > End - Cluster)
+            Bits = End - Cluster;
+
+        if (Bits == 32)
+            Mask = 0xFFFFFFFF;
+        else
+            Mask = ((1 << Bits) - 1) << (Cluster & 0x1F);
+
+        New = Mask & ~FBits[Cluster >> 5];
+
+        if (New)
+        {
+            FBits[Cluster >> 5] |= New;
+            FGroupFree[Cluster >> FAT_BITMAP_GROUP_SHIFT] += FatBitCount(New);
+        }
+
+        Cluster += Bits;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::SetFreeMask
+#
+#   Purpose....: Mark clusters as free from free masks
+#
+#   In params..: Cluster        First cluster, multiple of 32
+#                Mask           Free masks, one bit per cluster
+#                Words          Number of mask words
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatBitmap::SetFreeMask(unsigned int Cluster, const unsigned int *Mask, unsigned int Words)
+{
+    unsigned int Index = Cluster >> 5;
+    unsigned int Last = FClusters >> 5;
+    unsigned int New;
+    unsigned int i;
+
+    if (Index < FWords)
+        InvalidateLarge(Cluster, Cluster + Words * 32);
+
+    for (i = 0; i < Words && Index + i < FWords; i++)
+    {
+        New = Mask[i] & ~FBits[Index + i];
+
+        if (Index + i == 0)
+            New &= 0xFFFFFFFC;
+
+        if (Index + i == Last)
+            New &= (1 << (FClusters & 0x1F)) - 1;
+
+        if (New)
+        {
+            FBits[Index + i] |= New;
+            FGroupFree[((Index + i) << 5) >> FAT_BITMAP_GROUP_SHIFT] += FatBitCount(New);
+        }
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::Scan
+#
+#   Purpose....: Scan for first free cluster in a range, a word at a time.
+#                Groups without free clusters are skipped as a whole.
+#
+#   In params..: Start          First cluster to check
+#                End            First cluster beyond range
+#   Out params.: *
+#   Returns....: Cluster, or 0 if none is free
+#
+##########################################################################*/
+unsigned int TFatBitmap::Scan(unsigned int Start, unsigned int End)
+{
+    unsigned int Word = Start >> 5;
+    unsigned int EndWord = (End + 31) >> 5;
+    unsigned int val;
+    unsigned int Cluster;
+
+    if (Start >= End)
+        return 0;
+
+    val = FBits[Word] & (0xFFFFFFFF << (Start & 0x1F));
+
+    for (;;)
+    {
+        if (val)
+        {
+            Cluster = (Word << 5) + FindFirstBit(val);
+            if (Cluster < End)
+                return Cluster;
+            else
+                return 0;
+        }
+
+        Word++;
+        if (Word >= EndWord)
+            return 0;
+
+        if ((Word & 0x1F) == 0)
+        {
+            while (FGroupFree[Word >> 5] == 0)
+            {
+                Word += 32;
+                if (Word >= EndWord)
+                    return 0;
+            }
+        }
+
+        val = FBits[Word];
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::ScanUsed
+#
+#   Purpose....: Scan for first used cluster in a range, a word at a time.
+#                Groups that are entirely free are skipped as a whole.
+#
+#   In params..: Start          First cluster to check
+#                End            First cluster beyond range
+#   Out params.: *
+#   Returns....: Cluster, or End if all are free
+#
+##########################################################################*/
+unsigned int TFatBitmap::ScanUsed(unsigned int Start, unsigned int End)
+{
+    unsigned int Word = Start >> 5;
+    unsigned int EndWord = (End + 31) >> 5;
+    unsigned int val;
+    unsigned int Cluster;
+
+    if (Start >= End)
+        return End;
+
+    val = ~FBits[Word] & (0xFFFFFFFF << (Start & 0x1F));
+
+    for (;;)
+    {
+        if (val)
+        {
+            Cluster = (Word << 5) + FindFirstBit(val);
+            if (Cluster < End)
+                return Cluster;
+            else
+                return End;
+        }
+
+        Word++;
+        if (Word >= EndWord)
+            return End;
+
+        if ((Word & 0x1F) == 0)
+        {
+            while (FGroupFree[Word >> 5] == FAT_BITMAP_GROUP_SIZE)
+            {
+                Word += 32;
+                if (Word >= EndWord)
+                    return End;
+            }
+        }
+
+        val = ~FBits[Word];
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::ScanTail
+#
+#   Purpose....: Find start of the free clusters at the end of a range,
+#                a word at a time from the end
+#
+#   In params..: Start          First cluster of range
+#                End            First cluster beyond range
+#   Out params.: *
+#   Returns....: First cluster of free tail, or End if last cluster is used
+#
+##########################################################################*/
+unsigned int TFatBitmap::ScanTail(unsigned int Start, unsigned int End)
+{
+    unsigned int Word;
+    unsigned int val;
+    unsigned int Cluster;
+
+    if (Start >= End)
+        return End;
+
+    Word = (End - 1) >> 5;
+    val = ~FBits[Word];
+
+    if ((End & 0x1F) != 0)
+        val &= (1 << (End & 0x1F)) - 1;
+
+    for (;;)
+    {
+        if (val)
+        {
+            Cluster = (Word << 5) + FindLastBit(val) + 1;
+            if (Cluster > Start)
+                return Cluster;
+            else
+                return Start;
+        }
+
+        if (Word <= (Start >> 5))
+            return Start;
+
+        Word--;
+        val = ~FBits[Word];
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::FindFree
+#
+#   Purpose....: Find free cluster, starting at Start and wrapping around
+#
+#   In params..: Start          Preferred cluster
+#   Out params.: *
+#   Returns....: Cluster, or 0 if volume is full
+#
+##########################################################################*/
+unsigned int TFatBitmap::FindFree(unsigned int Start)
+{
+    unsigned int Cluster;
+
+    if (!FBits)
+        return 0;
+
+    if (Start < 2 || Start >= FClusters)
+        Start = 2;
+
+    Cluster = Scan(Start, FClusters);
+
+    if (!Cluster && Start > 2)
+        Cluster = Scan(2, Start);
+
+    return Cluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatBitmap::FindRun
+#
+#   Purpose....: Find a contiguous run of free clusters.
+#                If Start is free the run starting there is used, so a
+#                chain can be extended in place. Otherwise groups are
+#                visited from the group of Start, and groups whose largest
+#                free extent is too small are skipped. For those, only the
+#                free extent at the end is checked, in case it continues
+#                into the next group. The smallest extent
+#                that can hold Count clusters among the first
+#                FAT_BITMAP_FIT_EXTENTS extents checked is used (best-fit).
+#                If no such extent is found, the largest extent checked is
+#                returned, or the largest extent of the group with the
+#                largest extent, and the caller requests the remainder
+#                again
+#
+#   In params..: Start          Preferred cluster
+#                Count          Wanted clusters
+#   Out params.: Size           Clusters in returned run (<= Count)
+#   Returns....: First cluster in run, or 0 if volume is full
+#
+##########################################################################*/
+unsigned int TFatBitmap::FindRun(unsigned int Start, unsigned int Count, unsigned int *Size)
+{
+    unsigned int Group;
+    unsigned int Need;
+    unsigned int Large;
+    unsigned int Pos;
+    unsigned int End;
+    unsigned int Ext;
+    unsigned int Len;
+    unsigned int BestStart = 0;
+    unsigned int BestLen = 0;
+    unsigned int LargeStart = 0;
+    unsigned int LargeLen = 0;
+    unsigned int LargeGroup = 0;
+    unsigned int LargeGroupLen = 0;
+    unsigned int i;
+    int Extents = 0;
+
+    *Size = 0;
+
+    if (!FBits || !Count)
+        return 0;
+
+    if (Start < 2 || Start >= FClusters)
+        Start = 2;
+
+    if (IsFree(Start))
+    {
+        Len = ScanUsed(Start, FClusters) - Start;
+        if (Len > Count)
+            Len = Count;
+
+        *Size = Len;
+        return Start;
+    }
+
+    Need = Count;
+    if (Need > FAT_BITMAP_GROUP_SIZE)
+        Need = FAT_BITMAP_GROUP_SIZE;
+
+    Group = Start >> FAT_BITMAP_GROUP_SHIFT;
+
+    for (i = 0; i < FGroups && Extents < FAT_BITMAP_FIT_EXTENTS; i++)
+    {
+        Large = GetGroupLarge(Group);
+
+        if (Large > LargeGroupLen)
+        {
+            LargeGroup = Group;
+            LargeGroupLen = Large;
+        }
+
+        Pos = Group << FAT_BITMAP_GROUP_SHIFT;
+        End = Pos + FAT_BITMAP_GROUP_SIZE;
+
+        if (Pos < 2)
+            Pos = 2;
+
+        if (End > FClusters)
+            End = FClusters;
+
+        if (Large < Need && Large && IsFree(End - 1) && IsFree(End))
+        {
+            Ext = ScanTail(Pos, End);
+            Len = ScanUsed(Ext, FClusters) - Ext;
+
+            if (Len >= Count)
+            {
+                *Size = Count;
+                return Ext;
+            }
+
+            if (Len > LargeLen)
+            {
+                LargeStart = Ext;
+                LargeLen = Len;
+            }
+
+            Extents++;
+        }
+
+        if (Large >= Need)
+        {
+            while (Pos < End && Extents < FAT_BITMAP_FIT_EXTENTS)
+            {
+                Ext = Scan(Pos, End);
+                if (!Ext)
+                    break;
+
+                Len = ScanUsed(Ext, FClusters) - Ext;
+
+                if (Len == Count)
+                {
+                    *Size = Len;
+                    return Ext;
+                }
+
+                if (Len > Count)
+                {
+                    if (!BestLen || Len < BestLen)
+                    {
+                        BestStart = Ext;
+                        BestLen = Len;
+                    }
+                }
+                else
+                {
+                    if (Len > LargeLen)
+                    {
+                        LargeStart = Ext;
+                        LargeLen = Len;
+                    }
+                }
+
+                Pos = Ext + Len;
+                Extents++;
+            }
+        }
+
+        Group++;
+        if (Group >= FGroups)
+            Group = 0;
+    }
+
+    if (BestLen)
+    {
+        *Size = Count;
+        return BestStart;
+    }
+
+    if (LargeLen)
+    {
+        *Size = LargeLen;
+        return LargeStart;
+    }
+
+    if (LargeGroupLen)
+    {
+        Pos = LargeGroup << FAT_BITMAP_GROUP_SHIFT;
+        End = Pos + FAT_BITMAP_GROUP_SIZE;
+
+        if (Pos < 2)
+            Pos = 2;
+
+        if (End > FClusters)
+            End = FClusters;
+
+        while (Pos < End)
+        {
+            Ext = Scan(Pos, End);
+            if (!Ext)
+                break;
+
+            Len = ScanUsed(Ext, End) - Ext;
+            if (Len == LargeGroupLen)
+            {
+                Len = ScanUsed(Ext, FClusters) - Ext;
+                if (Len > Count)
+                    Len = Count;
+
+                *Size = Len;
+                return Ext;
+            }
+
+            Pos = Ext + Len;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# bitmap.h
+# Free cluster bitmap
+#
+########################################################################*/
+
+#ifndef _FAT_BITMAP_H
+#define _FAT_BITMAP_H
+
+#define FAT_BITMAP_GROUP_SHIFT  10
+#define FAT_BITMAP_GROUP_SIZE   (1 << FAT_BITMAP_GROUP_SHIFT)
+#define FAT_BITMAP_FIT_EXTENTS  64
+#define FAT_BITMAP_LARGE_UNKNOWN    0xFFFF
+
+class TFatBitmap
+{
+public:
+    TFatBitmap();
+    ~TFatBitmap();
+
+    void Setup(unsigned int Clusters);
+    void Reset();
+    bool IsValid();
+    unsigned int GetGroups();
+    unsigned int GetGroupFree(unsigned int Group);
+    unsigned int GetGroupLarge(unsigned int Group);
+
+    bool IsFree(unsigned int Cluster);
+    void SetFree(unsigned int Cluster);
+    void SetUsed(unsigned int Cluster);
+    void SetFreeRun(unsigned int Cluster, unsigned int Count);
+    void SetFreeMask(unsigned int Cluster, const unsigned int *Mask, unsigned int Words);
+
+    unsigned int FindFree(unsigned int Start);
+    unsigned int FindRun(unsigned int Start, unsigned int Count, unsigned int *Size);
+
+protected:
+    unsigned int Scan(unsigned int Start, unsigned int End);
+    unsigned int ScanUsed(unsigned int Start, unsigned int End);
+    unsigned int ScanTail(unsigned int Start, unsigned int End);
+    void InvalidateLarge(unsigned int Start, unsigned int End);
+
+    unsigned int *FBits;
+    unsigned int FClusters;
+    unsigned int FWords;
+
+    unsigned short int *FGroupFree;
+    unsigned short int *FGroupLarge;
+    unsigned int FGroups;
+};
+
+#endif
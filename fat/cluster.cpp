@@ -30,15 +30,15 @@
 ########################################################################*/
 
 #include <string.h>
-#include <rdos.h>
-#include <serv.h>
 #include "cluster.h"
 
 /*##########################################################################
 #
 #   Name       : TCluster::TCluster
 #
-#   Purpose....: Cluster chain constructor
+#   Purpose....: Cluster chain constructor. The chain is kept as a list
+#                of extents (runs of consecutive clusters). Workers
+#                share the chain, so all access goes through the section
 #
 #   In params..: *
 #   Out params.: *
@@ -46,7 +46,13 @@
 #
 ##########################################################################*/
 TCluster::TCluster()
+  : FSection("Cluster")
 {
+    FExtArr = 0;
+    FExtCount = 0;
+    FExtSize = 0;
+    FClusters = 0;
+    FCursor = 0;
 }
 
 /*##########################################################################
@@ -62,6 +68,8 @@ TCluster::TCluster()
 ##########################################################################*/
 TCluster::~TCluster()
 {
+    if (FExtArr)
+        delete FExtArr;
 }
 
 /*##########################################################################
@@ -77,16 +85,70 @@ TCluster::~TCluster()
 ##########################################################################*/
 void TCluster::Add(unsigned int Cluster)
 {
-    unsigned int *chain;
-    char *ptr;
-    int Pos;
+    AddRun(Cluster, 1);
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::AddRun
+#
+#   Purpose....: Add run of consecutive clusters. The last extent is
+#                extended if the run follows it
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TCluster::AddRun(unsigned int Cluster, unsigned int Count)
+{
+    struct TClusterExtent *Ext;
+    struct TClusterExtent *NewArr;
+
+    if (!Count)
+        return;
+
+    FSection.Enter();
+
+    if (FExtCount)
+    {
+        Ext = &FExtArr[FExtCount - 1];
+        if (Ext->Cluster + Ext->Count == Cluster)
+        {
+            Ext->Count += Count;
+            FClusters += Count;
+            FSection.Leave();
+            return;
+        }
+    }
+
+    if (FExtCount == FExtSize)
+    {
+        if (FExtSize)
+            FExtSize *= 2;
+        else
+            FExtSize = CLUSTER_EXTENT_GROW;
 
-    Pos = TBlock::Add(sizeof(unsigned int));
+        NewArr = new struct TClusterExtent[FExtSize];
 
-    ptr = (char *)obj;
-    ptr += Pos;
-    chain = (unsigned int *)ptr;
-    *chain = Cluster;
+        if (FExtArr)
+        {
+            memcpy(NewArr, FExtArr, FExtCount * sizeof(struct TClusterExtent));
+            delete FExtArr;
+        }
+        FExtArr = NewArr;
+    }
+
+    Ext = &FExtArr[FExtCount];
+    Ext->Pos = FClusters;
+    Ext->Cluster = Cluster;
+    Ext->Count = Count;
+
+    FExtCount++;
+    FClusters += Count;
+
+    FSection.Leave();
 }
 
 /*##########################################################################
@@ -102,7 +164,63 @@ void TCluster::Add(unsigned int Cluster)
 ##########################################################################*/
 void TCluster::Sub()
 {
-    TBlock::Sub(sizeof(unsigned int));
+    FSection.Enter();
+
+    if (FExtCount)
+    {
+        FExtArr[FExtCount - 1].Count--;
+        FClusters--;
+
+        if (FExtArr[FExtCount - 1].Count == 0)
+        {
+            FExtCount--;
+            if (FCursor >= FExtCount)
+                FCursor = 0;
+        }
+    }
+
+    FSection.Leave();
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::SubRun
+#
+#   Purpose....: Remove clusters from the end, an extent at a time
+#
+#   In params..: Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TCluster::SubRun(unsigned int Count)
+{
+    struct TClusterExtent *Ext;
+
+    FSection.Enter();
+
+    while (Count && FExtCount)
+    {
+        Ext = &FExtArr[FExtCount - 1];
+
+        if (Ext->Count > Count)
+        {
+            Ext->Count -= Count;
+            FClusters -= Count;
+            Count = 0;
+        }
+        else
+        {
+            Count -= Ext->Count;
+            FClusters -= Ext->Count;
+            FExtCount--;
+        }
+    }
+
+    if (FCursor >= FExtCount)
+        FCursor = 0;
+
+    FSection.Leave();
 }
 
 /*##########################################################################
@@ -118,32 +236,219 @@ void TCluster::Sub()
 ##########################################################################*/
 int TCluster::GetSize()
 {
-    int start = sizeof(struct TShareHeader);
-    int size = pos - start;
+    return (int)FClusters;
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::Find
+#
+#   Purpose....: Find extent that contains a chain position. The extent
+#                of the last lookup and the one after it are tried
+#                first, since most accesses are sequential. Caller must
+#                be in the section
+#
+#   In params..: Pos            Position in chain
+#   Out params.: *
+#   Returns....: Extent index
+#
+##########################################################################*/
+int TCluster::Find(unsigned int Pos)
+{
+    struct TClusterExtent *Ext;
+    int Low;
+    int High;
+    int Mid;
+
+    Ext = &FExtArr[FCursor];
+    if (Pos >= Ext->Pos)
+    {
+        if (Pos < Ext->Pos + Ext->Count)
+            return FCursor;
+
+        if (FCursor + 1 < FExtCount)
+        {
+            Ext++;
+            if (Pos < Ext->Pos + Ext->Count)
+            {
+                FCursor++;
+                return FCursor;
+            }
+        }
+    }
 
-    return size / sizeof(unsigned int);
+    Low = 0;
+    High = FExtCount - 1;
+
+    while (Low < High)
+    {
+        Mid = (Low + High + 1) / 2;
+
+        if (FExtArr[Mid].Pos <= Pos)
+            Low = Mid;
+        else
+            High = Mid - 1;
+    }
+
+    FCursor = Low;
+    return Low;
 }
 
 /*##########################################################################
 #
-#   Name       : TCluster::GetChain
+#   Name       : TCluster::Get
 #
-#   Purpose....: Get cluster chain
+#   Purpose....: Get cluster at chain position
+#
+#   In params..: Pos            Position in chain
+#   Out params.: *
+#   Returns....: Cluster, or 0 if position is outside chain
+#
+##########################################################################*/
+unsigned int TCluster::Get(unsigned int Pos)
+{
+    struct TClusterExtent *Ext;
+    unsigned int Cluster = 0;
+
+    FSection.Enter();
+
+    if (Pos < FClusters)
+    {
+        Ext = &FExtArr[Find(Pos)];
+        Cluster = Ext->Cluster + Pos - Ext->Pos;
+    }
+
+    FSection.Leave();
+
+    return Cluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::GetLast
+#
+#   Purpose....: Get last cluster in chain
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: Cluster, or 0 if chain is empty
+#
+##########################################################################*/
+unsigned int TCluster::GetLast()
+{
+    struct TClusterExtent *Ext;
+    unsigned int Cluster = 0;
+
+    FSection.Enter();
+
+    if (FExtCount)
+    {
+        Ext = &FExtArr[FExtCount - 1];
+        Cluster = Ext->Cluster + Ext->Count - 1;
+    }
+
+    FSection.Leave();
+
+    return Cluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::GetExtentCount
+#
+#   Purpose....: Get number of extents
 #
 #   In params..: *
 #   Out params.: *
 #   Returns....: *
 #
 ##########################################################################*/
-unsigned int *TCluster::GetChain()
+int TCluster::GetExtentCount()
+{
+    return FExtCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::GetExtent
+#
+#   Purpose....: Get copy of extent
+#
+#   In params..: Index          Extent index
+#   Out params.: Ext            Extent
+#   Returns....: true if Index is valid
+#
+##########################################################################*/
+bool TCluster::GetExtent(int Index, struct TClusterExtent *Ext)
 {
-    int start = sizeof(struct TShareHeader);
-    unsigned int *chain;
-    char *ptr;
+    bool ok = false;
+
+    FSection.Enter();
+
+    if (Index >= 0 && Index < FExtCount)
+    {
+        *Ext = FExtArr[Index];
+        ok = true;
+    }
+
+    FSection.Leave();
+
+    return ok;
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::GetLastExtent
+#
+#   Purpose....: Get copy of last extent
+#
+#   In params..: *
+#   Out params.: Ext            Extent
+#   Returns....: true if chain is not empty
+#
+##########################################################################*/
+bool TCluster::GetLastExtent(struct TClusterExtent *Ext)
+{
+    bool ok = false;
+
+    FSection.Enter();
+
+    if (FExtCount)
+    {
+        *Ext = FExtArr[FExtCount - 1];
+        ok = true;
+    }
+
+    FSection.Leave();
+
+    return ok;
+}
+
+/*##########################################################################
+#
+#   Name       : TCluster::Lookup
+#
+#   Purpose....: Get copy of extent that holds chain position. A copy is
+#                returned since the extent array moves when it grows
+#
+#   In params..: Pos            Position in chain
+#   Out params.: Ext            Extent
+#   Returns....: true if Pos is inside the chain
+#
+##########################################################################*/
+bool TCluster::Lookup(unsigned int Pos, struct TClusterExtent *Ext)
+{
+    bool ok = false;
+
+    FSection.Enter();
+
+    if (Pos < FClusters)
+    {
+        *Ext = FExtArr[Find(Pos)];
+        ok = true;
+    }
 
-    ptr = (char *)obj;
-    ptr += start;
-    chain = (unsigned int *)ptr;
+    FSection.Leave();
 
-    return chain;
+    return ok;
 }
@@ -32,22 +32,45 @@
 #ifndef _CLUSTER_H
 #define _CLUSTER_H
 
-#include "block.h"
 #include "section.h"
 
-class TCluster : public TBlock
+#define CLUSTER_EXTENT_GROW     16
+
+struct TClusterExtent
+{
+    unsigned int Pos;
+    unsigned int Cluster;
+    unsigned int Count;
+};
+
+class TCluster
 {
 public:
     TCluster();
     virtual ~TCluster();
 
     void Add(unsigned int Cluster);
+    void AddRun(unsigned int Cluster, unsigned int Count);
     void Sub();
+    void SubRun(unsigned int Count);
     int GetSize();
-    unsigned int *GetChain();
+    unsigned int Get(unsigned int Pos);
+    unsigned int GetLast();
+
+    int GetExtentCount();
+    bool GetExtent(int Index, struct TClusterExtent *Ext);
+    bool GetLastExtent(struct TClusterExtent *Ext);
+    bool Lookup(unsigned int Pos, struct TClusterExtent *Ext);
 
 protected:
+    int Find(unsigned int Pos);
+
+    struct TClusterExtent *FExtArr;
+    int FExtCount;
+    int FExtSize;
+    unsigned int FClusters;
+    int FCursor;
+    TSection FSection;
 };
 
 #endif
-
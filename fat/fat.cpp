@@ -42,11 +42,14 @@
 #include "fat12.h"
 #include "fat16.h"
 #include "fat32.h"
+#include "fatkern.h"
 
 bool Started = false;
 TFat *Fs = 0;
 const char *FsName = 0;
 
+struct TFatOptions FatOptions = {FAT_CACHE_DEFAULT_SECTORS, 1000, false, true, FAT_KERNEL_AUTO, false, 4096, 4, 1024, 1024};
+
 /*##########################################################################
 #
 #   Name       : LogError
@@ -650,6 +653,183 @@ void GenerateShortName(const char *name, int index, char *buf)
     }
 }
 
+/*##########################################################################
+#
+#   Name       : ParseOption
+#
+#   Purpose....: Parse mount option. Options are given as name=value
+#
+#                cache=<KB>     FAT cache budget for the mount, stored as
+#                               512 byte sectors, 4 - 4096 KB
+#                flush=<ms>     Interval for writing dirty FAT sectors
+#                mirror=on|off  Use FAT1 only at runtime, and copy flushed
+#                               FAT1 sectors to FAT2 (default off)
+#                scan=background|mount
+#                               Count free clusters in a background
+#                               thread, or before mount completes
+#                               (default background)
+#                kernel=auto|c|sse2|avx2
+#                               FAT entry kernels (default auto)
+#                bench=on       Print cycles per entry for FAT entry
+#                               kernels
+#                prealloc=<KB>  Largest speculative preallocation for a
+#                               growing file, 0 disables (default 4096)
+#                workers=<n>    I/O worker threads for the partition. Files
+#                               are spread over workers, 1 handles all
+#                               requests in the server thread (default 4)
+#                queue=<n>      Entries in the kernel I/O queue, rounded up
+#                               to a power of two, 256 - 4096
+#                               (default 1024)
+#                readahead=<KB> Largest readahead window for sequential
+#                               reads, 0 disables (default 1024)
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: true if option was recognized
+#
+##########################################################################*/
+bool ParseOption(const char *option)
+{
+    const char *val;
+    int kb;
+    int ms;
+    int level;
+    int count;
+
+    val = strchr(option, '=');
+    if (!val)
+        return false;
+
+    val++;
+
+    if (!strncmp(option, "cache=", 6))
+    {
+        kb = atoi(val);
+        if (kb > 0)
+        {
+            if (kb > FAT_CACHE_MAX_WINDOWS * FAT_CACHE_MAX_WINDOW / 2)
+                kb = FAT_CACHE_MAX_WINDOWS * FAT_CACHE_MAX_WINDOW / 2;
+
+            count = kb * 1024 / 512;
+
+            if (count < FAT_CACHE_MIN_WINDOW)
+                count = FAT_CACHE_MIN_WINDOW;
+
+            if (count > FAT_CACHE_MAX_WINDOWS * FAT_CACHE_MAX_WINDOW)
+                count = FAT_CACHE_MAX_WINDOWS * FAT_CACHE_MAX_WINDOW;
+
+            FatOptions.CacheSize = count;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "flush=", 6))
+    {
+        ms = atoi(val);
+        if (ms > 0)
+        {
+            FatOptions.FlushInterval = ms;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "mirror=", 7))
+    {
+        if (!strcmp(val, "on"))
+        {
+            FatOptions.Mirror = true;
+            return true;
+        }
+
+        if (!strcmp(val, "off"))
+        {
+            FatOptions.Mirror = false;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "scan=", 5))
+    {
+        if (!strcmp(val, "background"))
+        {
+            FatOptions.BackgroundScan = true;
+            return true;
+        }
+
+        if (!strcmp(val, "mount"))
+        {
+            FatOptions.BackgroundScan = false;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "kernel=", 7))
+    {
+        for (level = FAT_KERNEL_C; level <= FAT_KERNEL_AVX2; level++)
+        {
+            if (!strcmp(val, FatKernelName(level)))
+            {
+                FatOptions.Kernel = level;
+                return true;
+            }
+        }
+
+        if (!strcmp(val, "auto"))
+        {
+            FatOptions.Kernel = FAT_KERNEL_AUTO;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "prealloc=", 9))
+    {
+        kb = atoi(val);
+        if (kb >= 0)
+        {
+            FatOptions.Prealloc = kb;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "workers=", 8))
+    {
+        count = atoi(val);
+        if (count > 0 && count <= FS_MAX_WORKERS)
+        {
+            FatOptions.Workers = count;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "queue=", 6))
+    {
+        count = atoi(val);
+        if (count >= FS_MIN_QUEUE_ENTRIES && count <= FS_MAX_QUEUE_ENTRIES)
+        {
+            FatOptions.QueueSize = count;
+            return true;
+        }
+    }
+
+    if (!strncmp(option, "readahead=", 10))
+    {
+        kb = atoi(val);
+        if (kb >= 0)
+        {
+            FatOptions.ReadAhead = kb;
+            return true;
+        }
+    }
+
+    if (!strcmp(option, "bench=on"))
+    {
+        FatOptions.Bench = true;
+        return true;
+    }
+
+    return false;
+}
+
 /*##########################################################################
 #
 #   Name       : StartFs
@@ -755,6 +935,8 @@ void StartFs(TPartServer *Server)
             delete Fs;
             Fs = 0;
         }
+        else
+            Fs->LogCacheStats();
     }
 }
 
@@ -878,6 +1060,7 @@ int main(int argc, char **argv)
 {
     int dev;
     int unit;
+    int i;
     char *ptr;
     TPartServer *Server;
 
@@ -891,6 +1074,15 @@ int main(int argc, char **argv)
 
         FsName = argv[3];
 
+        for (i = 4; i < argc; i++)
+            if (!ParseOption(argv[i]))
+                printf("Unknown option: %s\r\n", argv[i]);
+
+        FatKernelSetup(FatOptions.Kernel);
+
+        if (FatOptions.Bench)
+            FatKernelBench();
+
         Server = new TPartServer;
         Server->OnStart = StartFs;
         Server->OnFormat = FormatFs;
@@ -900,7 +1092,10 @@ int main(int argc, char **argv)
                 break;
 
         if (Fs)
+        {
             Fs->Run();
+            Fs->LogCacheStats();
+        }
 
         Server->Disable();
 
@@ -49,6 +49,22 @@ struct TFatDirEntry
     unsigned int FileSize;
 };
 
+struct TFatOptions
+{
+    int CacheSize;
+    int FlushInterval;
+    bool Mirror;
+    bool BackgroundScan;
+    int Kernel;
+    bool Bench;
+    int Prealloc;
+    int Workers;
+    int QueueSize;
+    int ReadAhead;
+};
+
+extern struct TFatOptions FatOptions;
+
 unsigned int GetCluster(struct TFatDirEntry *entry);
 long long DecodeTime(short int Date, short int Time, unsigned char Ms);
 void EncodeTime(long long RdosTime, short int *Date, short int *Time, unsigned char *Ms);
@@ -65,6 +81,8 @@ bool IsValidShortChar(char ch);
 bool IsValidShortName(const char *buf);
 void GenerateShortName(const char *name, int index, char *buf);
 
+bool ParseOption(const char *option);
+
 
 #endif
 
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <rdos.h>
 #include <serv.h>
+#include "fat.h"
 #include "fat12.h"
 
 /*##########################################################################
@@ -55,7 +56,9 @@ bool TFat12::InitFs(TPartServer *server, struct TBootSector12_16 *boot)
 #
 #   Name       : TFat12::TFat12
 #
-#   Purpose....: Fat12 constructor
+#   Purpose....: Fat12 constructor. The FAT12 table does not write
+#                through the dirty sector set, so FAT2 cannot be a
+#                mirror of FAT1, and both tables are always written
 #
 #   In params..: *
 #   Out params.: *
@@ -71,6 +74,7 @@ TFat12::TFat12(TPartServer *server, struct TBootSector12_16 *boot, bool format)
     unsigned int Free2;
 
     FatSize = 12;
+    FMirror = false;
     PartSectors = boot->base.SectorCount16;
     if (!PartSectors)
         PartSectors = boot->base.Sectors;
@@ -94,6 +98,9 @@ TFat12::TFat12(TPartServer *server, struct TBootSector12_16 *boot, bool format)
         if (Clusters > 0xFF0)
             Clusters = 0xFF0;
 
+        Tab1.SetCacheSize(FatOptions.CacheSize);
+        Tab2.SetCacheSize(FatOptions.CacheSize);
+
         Tab1.Setup(SectorsPerCluster, Fat1Sector, FatSectors, Clusters);
         Tab2.Setup(SectorsPerCluster, Fat2Sector, FatSectors, Clusters);
 
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <rdos.h>
 #include <serv.h>
+#include "fat.h"
 #include "fat16.h"
 
 #define ROOT_DIR_SECTORS	32
@@ -302,9 +303,15 @@ TFat16::TFat16(TPartServer *server, struct TBootSector12_16 *boot, bool format)
         if (Clusters > 0xFFF0)
             Clusters = 0xFFF0;
 
+        Tab1.SetCacheSize(FatOptions.CacheSize);
+        Tab2.SetCacheSize(FatOptions.CacheSize);
+
         Tab1.Setup(SectorsPerCluster, Fat1Sector, FatSectors, Clusters);
         Tab2.Setup(SectorsPerCluster, Fat2Sector, FatSectors, Clusters);
 
+        if (FMirror)
+            Tab1.SetMirror(Fat2Sector);
+
         if (format)
         {
             Free1 = Tab1.FormatClusters();
@@ -318,15 +325,7 @@ TFat16::TFat16(TPartServer *server, struct TBootSector12_16 *boot, bool format)
             FormatFixedDir(RootSector, RootDirEntries);
         }
         else
-        {
-            Free1 = Tab1.GetFreeClusters();
-            Free2 = Tab2.GetFreeClusters();
-
-            if (Free1 > Free2)
-                FreeClusters = Free2;
-            else
-                FreeClusters = Free1;
-        }
+            SetupScan();
     }
 }
 
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <rdos.h>
 #include <serv.h>
+#include "fat.h"
 #include "fat32.h"
 
 struct TFatInfo
@@ -291,6 +292,8 @@ TFat32::TFat32(TPartServer *server, struct TBootSector32 *boot, bool format)
 
     RootCluster = boot->RootCluster;
     InfoSector = boot->InfoSector;
+    BackupSector = boot->BackupSector;
+    NextCluster = 0;
 
     if (Validate())
     {
@@ -308,13 +311,24 @@ TFat32::TFat32(TPartServer *server, struct TBootSector32 *boot, bool format)
             Clusters = 0xFFFFFFF0;
 
         if (!format)
-            if (Clusters > 0x200000)
-                if (InfoSector)
-                    ProcessInfoSector();
+            if (InfoSector)
+                ProcessInfoSector();
+
+        Tab1.SetCacheSize(FatOptions.CacheSize);
+        Tab2.SetCacheSize(FatOptions.CacheSize);
 
         Tab1.Setup(SectorsPerCluster, Fat1Sector, FatSectors, Clusters);
         Tab2.Setup(SectorsPerCluster, Fat2Sector, FatSectors, Clusters);
 
+        if (FMirror)
+            Tab1.SetMirror(Fat2Sector);
+
+        if (NextCluster)
+        {
+            Tab1.SetAllocateCluster(NextCluster);
+            Tab2.SetAllocateCluster(NextCluster);
+        }
+
         if (format)
         {
             Free1 = Tab1.FormatClusters();
@@ -329,18 +343,7 @@ TFat32::TFat32(TPartServer *server, struct TBootSector32 *boot, bool format)
             WriteBootSector(boot);
         }
         else
-        {
-            if (!FreeClusters)
-            {
-                Free1 = Tab1.GetFreeClusters();
-                Free2 = Tab2.GetFreeClusters();
-
-                if (Free1 > Free2)
-                    FreeClusters = Free2;
-                else
-                    FreeClusters = Free1;
-            }
-        }
+            SetupScan();
     }
 }
 
@@ -416,7 +419,8 @@ void TFat32::WriteBootSector(struct TBootSector32 *boot)
 #
 #   Name       : TFat32::ProcessInfoSector
 #
-#   Purpose....: Process info sector
+#   Purpose....: Process info sector. The allocation hint is always
+#                used, and the free count unless it is unknown
 #
 #   In params..: *
 #   Out params.: *
@@ -442,10 +446,74 @@ bool TFat32::ProcessInfoSector()
     if (info->InfoSign != 0x61417272)
         return false;
 
+    if ((unsigned int)info->NextCluster >= 2 && (unsigned int)info->NextCluster < Clusters)
+        NextCluster = info->NextCluster;
+
+    if ((unsigned int)info->FreeClusters > Clusters)
+        return false;
+
     FreeClusters = info->FreeClusters;
     return true;
 }
 
+/*##########################################################################
+#
+#   Name       : TFat32::UpdateInfo
+#
+#   Purpose....: Update info sector and its backup. While tables have
+#                changes that are not written, the free count is set
+#                to unknown, so it is only trusted after a clean stop
+#
+#   In params..: Valid          Tables are flushed, and info is valid
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat32::UpdateInfo(bool Valid)
+{
+    TPartReq req(FServer);
+    TPartReqEntry *e1;
+    TPartReqEntry *e2 = 0;
+    struct TFatInfo *info;
+    unsigned int Free;
+
+    if (!InfoSector)
+        return;
+
+    if (!Valid || !GetScannedFree(&Free))
+        Free = 0xFFFFFFFF;
+
+    e1 = new TPartReqEntry(&req, InfoSector, 1, false);
+
+    if (BackupSector > 0 && BackupSector < ReservedSectors)
+        e2 = new TPartReqEntry(&req, BackupSector + InfoSector, 1, false);
+
+    req.WaitForever();
+
+    info = (struct TFatInfo *)e1->Map();
+    if (info && info->ExtSign == 0x41615252 && info->InfoSign == 0x61417272)
+    {
+        info->FreeClusters = Free;
+        info->NextCluster = FatTable1->GetAllocateCluster();
+        e1->Write();
+    }
+
+    if (e2)
+    {
+        info = (struct TFatInfo *)e2->Map();
+        if (info && info->ExtSign == 0x41615252 && info->InfoSign == 0x61417272)
+        {
+            info->FreeClusters = Free;
+            info->NextCluster = FatTable1->GetAllocateCluster();
+            e2->Write();
+        }
+
+        delete e2;
+    }
+
+    delete e1;
+}
+
 /*##########################################################################
 #
 #   Name       : TFat32::CacheRootDir
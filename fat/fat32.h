@@ -55,9 +55,12 @@ protected:
     void WriteBootSector(struct TBootSector32 *boot);
 
     bool ProcessInfoSector();
+    virtual void UpdateInfo(bool Valid);
 
     unsigned int RootCluster;
     long long InfoSector;
+    long long BackupSector;
+    unsigned int NextCluster;
 
 private:
     TFatTable32 Tab1;
@@ -0,0 +1,557 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# fatcache.cpp
+# FAT sector cache
+#
+########################################################################*/
+
+#include "fatcache.h"
+
+/*##########################################################################
+#
+#   Name       : TFatCache::TFatCache
+#
+#   Purpose....: FAT sector cache constructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatCache::TFatCache()
+{
+    int i;
+
+    FReq = 0;
+    FStartSector = 0;
+    FFatSectors = 0;
+    FWindowSectors = 0;
+    FWindowCount = 0;
+    FWindowArr = 0;
+    FHead = -1;
+    FTail = -1;
+    FHits = 0;
+    FMisses = 0;
+    FPrefetches = 0;
+
+    for (i = 0; i < FAT_CACHE_HASH_SIZE; i++)
+        FHashArr[i] = -1;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::~TFatCache
+#
+#   Purpose....: FAT sector cache destructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatCache::~TFatCache()
+{
+    Clear();
+
+    if (FWindowArr)
+        delete FWindowArr;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Setup
+#
+#   Purpose....: Setup cache windows for a FAT table.
+#                If the whole table fits within MaxSectors it is made
+#                resident, otherwise MaxSectors is spread over at most
+#                FAT_CACHE_MAX_WINDOWS windows.
+#
+#   In params..: Req            Request to use for reads
+#                StartSector    First sector of table
+#                FatSectors     Sectors in table
+#                Align          Window size granularity
+#                MaxSectors     Sector budget
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::Setup(TPartReq *Req, long long StartSector, int FatSectors, int Align, int MaxSectors)
+{
+    int i;
+    int IndexCount;
+    struct TFatCacheWindow *w;
+
+    Clear();
+
+    if (FWindowArr)
+        delete FWindowArr;
+
+    FReq = Req;
+    FStartSector = StartSector;
+    FFatSectors = FatSectors;
+    FHits = 0;
+    FMisses = 0;
+    FPrefetches = 0;
+
+    if (MaxSectors < FAT_CACHE_MIN_WINDOW)
+        MaxSectors = FAT_CACHE_MIN_WINDOW;
+
+    if (FatSectors <= MaxSectors)
+        FWindowSectors = (FatSectors + FAT_CACHE_MAX_WINDOWS - 1) / FAT_CACHE_MAX_WINDOWS;
+    else
+        FWindowSectors = MaxSectors / FAT_CACHE_MAX_WINDOWS;
+
+    if (FWindowSectors < FAT_CACHE_MIN_WINDOW)
+        FWindowSectors = FAT_CACHE_MIN_WINDOW;
+
+    if (FWindowSectors > FAT_CACHE_MAX_WINDOW)
+        FWindowSectors = FAT_CACHE_MAX_WINDOW;
+
+    FWindowSectors = (FWindowSectors + Align - 1) / Align * Align;
+
+    IndexCount = (FatSectors + FWindowSectors - 1) / FWindowSectors;
+
+    if (FatSectors <= MaxSectors)
+        FWindowCount = IndexCount;
+    else
+        FWindowCount = MaxSectors / FWindowSectors;
+
+    if (FWindowCount > FAT_CACHE_MAX_WINDOWS)
+        FWindowCount = FAT_CACHE_MAX_WINDOWS;
+
+    if (FWindowCount > IndexCount)
+        FWindowCount = IndexCount;
+
+    if (FWindowCount < 1)
+        FWindowCount = 1;
+
+    FWindowArr = new struct TFatCacheWindow[FWindowCount];
+
+    for (i = 0; i < FAT_CACHE_HASH_SIZE; i++)
+        FHashArr[i] = -1;
+
+    FHead = -1;
+    FTail = -1;
+
+    for (i = 0; i < FWindowCount; i++)
+    {
+        w = &FWindowArr[i];
+        w->Entry = 0;
+        w->Data = 0;
+        w->Index = -1;
+        w->HashNext = -1;
+        LinkTail(i);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Clear
+#
+#   Purpose....: Release all cached windows
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::Clear()
+{
+    int i;
+
+    for (i = 0; i < FWindowCount; i++)
+        if (FWindowArr[i].Entry)
+            Drop(i);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Unlink
+#
+#   Purpose....: Remove window from LRU list
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::Unlink(int Slot)
+{
+    struct TFatCacheWindow *w = &FWindowArr[Slot];
+
+    if (w->Prev >= 0)
+        FWindowArr[w->Prev].Next = w->Next;
+    else
+        FHead = w->Next;
+
+    if (w->Next >= 0)
+        FWindowArr[w->Next].Prev = w->Prev;
+    else
+        FTail = w->Prev;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::LinkHead
+#
+#   Purpose....: Insert window as most recently used
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::LinkHead(int Slot)
+{
+    struct TFatCacheWindow *w = &FWindowArr[Slot];
+
+    w->Prev = -1;
+    w->Next = FHead;
+
+    if (FHead >= 0)
+        FWindowArr[FHead].Prev = Slot;
+    else
+        FTail = Slot;
+
+    FHead = Slot;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::LinkTail
+#
+#   Purpose....: Insert window as least recently used
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::LinkTail(int Slot)
+{
+    struct TFatCacheWindow *w = &FWindowArr[Slot];
+
+    w->Next = -1;
+    w->Prev = FTail;
+
+    if (FTail >= 0)
+        FWindowArr[FTail].Next = Slot;
+    else
+        FHead = Slot;
+
+    FTail = Slot;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Find
+#
+#   Purpose....: Find cached window
+#
+#   In params..: Index          Window index
+#   Out params.: *
+#   Returns....: Slot, or -1 if not cached
+#
+##########################################################################*/
+int TFatCache::Find(int Index)
+{
+    int Slot = FHashArr[Index % FAT_CACHE_HASH_SIZE];
+
+    while (Slot >= 0)
+    {
+        if (FWindowArr[Slot].Index == Index)
+            return Slot;
+
+        Slot = FWindowArr[Slot].HashNext;
+    }
+    return -1;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Drop
+#
+#   Purpose....: Release window contents. Slot stays in LRU list
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::Drop(int Slot)
+{
+    struct TFatCacheWindow *w = &FWindowArr[Slot];
+    int *prev;
+
+    prev = &FHashArr[w->Index % FAT_CACHE_HASH_SIZE];
+
+    while (*prev >= 0)
+    {
+        if (*prev == Slot)
+        {
+            *prev = w->HashNext;
+            break;
+        }
+        prev = &FWindowArr[*prev].HashNext;
+    }
+
+    delete w->Entry;
+
+    w->Entry = 0;
+    w->Data = 0;
+    w->Index = -1;
+    w->HashNext = -1;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::GetSector
+#
+#   Purpose....: Get mapped sector, reading its window if not cached.
+#                The least recently used window is replaced on miss
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: Sector data
+#
+##########################################################################*/
+char *TFatCache::GetSector(int RelSector)
+{
+    int Index = RelSector / FWindowSectors;
+    int Slot;
+    int Start;
+    int Count;
+    struct TFatCacheWindow *w;
+
+    Slot = Find(Index);
+
+    if (Slot >= 0)
+    {
+        FHits++;
+
+        if (Slot != FHead)
+        {
+            Unlink(Slot);
+            LinkHead(Slot);
+        }
+        w = &FWindowArr[Slot];
+
+        if (!w->Data)
+        {
+            FReq->WaitForever();
+            w->Data = w->Entry->Map();
+        }
+    }
+    else
+    {
+        FMisses++;
+
+        Slot = FTail;
+        w = &FWindowArr[Slot];
+
+        if (w->Entry)
+            Drop(Slot);
+
+        Start = Index * FWindowSectors;
+        Count = FFatSectors - Start;
+        if (Count > FWindowSectors)
+            Count = FWindowSectors;
+
+        w->Entry = new TPartReqEntry(FReq, FStartSector + Start, Count);
+        FReq->WaitForever();
+        w->Data = w->Entry->Map();
+        w->Index = Index;
+        w->HashNext = FHashArr[Index % FAT_CACHE_HASH_SIZE];
+        FHashArr[Index % FAT_CACHE_HASH_SIZE] = Slot;
+
+        Unlink(Slot);
+        LinkHead(Slot);
+    }
+
+    return w->Data + 512 * (RelSector - Index * FWindowSectors);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Prefetch
+#
+#   Purpose....: Start reading the window holding a sector, without
+#                waiting for it. GetSector waits when the window is used.
+#                The most recently used window is never replaced
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::Prefetch(int RelSector)
+{
+    int Index = RelSector / FWindowSectors;
+    int Slot;
+    int Start;
+    int Count;
+    struct TFatCacheWindow *w;
+
+    if (FWindowCount < 2 || RelSector < 0 || RelSector >= FFatSectors)
+        return;
+
+    if (Find(Index) >= 0)
+        return;
+
+    FPrefetches++;
+
+    Slot = FTail;
+    w = &FWindowArr[Slot];
+
+    if (w->Entry)
+        Drop(Slot);
+
+    Start = Index * FWindowSectors;
+    Count = FFatSectors - Start;
+    if (Count > FWindowSectors)
+        Count = FWindowSectors;
+
+    w->Entry = new TPartReqEntry(FReq, FStartSector + Start, Count);
+    w->Data = 0;
+    w->Index = Index;
+    w->HashNext = FHashArr[Index % FAT_CACHE_HASH_SIZE];
+    FHashArr[Index % FAT_CACHE_HASH_SIZE] = Slot;
+
+    Unlink(Slot);
+    LinkHead(Slot);
+
+    FReq->Start();
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::Invalidate
+#
+#   Purpose....: Release the window holding a sector, if cached.
+#                Other windows keep their mappings
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatCache::Invalidate(int RelSector)
+{
+    int Slot;
+
+    if (!FWindowArr)
+        return;
+
+    Slot = Find(RelSector / FWindowSectors);
+
+    if (Slot >= 0)
+    {
+        Drop(Slot);
+        Unlink(Slot);
+        LinkTail(Slot);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::GetWindowSectors
+#
+#   Purpose....: Get sectors per window
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFatCache::GetWindowSectors()
+{
+    return FWindowSectors;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::GetWindowCount
+#
+#   Purpose....: Get number of windows
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFatCache::GetWindowCount()
+{
+    return FWindowCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::GetHits
+#
+#   Purpose....: Get cache hits
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatCache::GetHits()
+{
+    return FHits;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::GetMisses
+#
+#   Purpose....: Get cache misses
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatCache::GetMisses()
+{
+    return FMisses;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatCache::GetPrefetches
+#
+#   Purpose....: Get number of windows read ahead
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatCache::GetPrefetches()
+{
+    return FPrefetches;
+}
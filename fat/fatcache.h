@@ -0,0 +1,97 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# fatcache.h
+# FAT sector cache
+#
+########################################################################*/
+
+#ifndef _FAT_CACHE_H
+#define _FAT_CACHE_H
+
+#include "partint.h"
+
+#define FAT_CACHE_MAX_WINDOWS       128
+#define FAT_CACHE_MIN_WINDOW        8
+#define FAT_CACHE_MAX_WINDOW        64
+#define FAT_CACHE_DEFAULT_SECTORS   2048
+#define FAT_CACHE_HASH_SIZE         256
+
+struct TFatCacheWindow
+{
+    TPartReqEntry *Entry;
+    char *Data;
+    int Index;
+    int HashNext;
+    int Prev;
+    int Next;
+};
+
+class TFatCache
+{
+public:
+    TFatCache();
+    ~TFatCache();
+
+    void Setup(TPartReq *Req, long long StartSector, int FatSectors, int Align, int MaxSectors);
+    void Clear();
+
+    char *GetSector(int RelSector);
+    void Prefetch(int RelSector);
+    void Invalidate(int RelSector);
+
+    int GetWindowSectors();
+    int GetWindowCount();
+    unsigned int GetHits();
+    unsigned int GetMisses();
+    unsigned int GetPrefetches();
+
+protected:
+    void Unlink(int Slot);
+    void LinkHead(int Slot);
+    void LinkTail(int Slot);
+    void Drop(int Slot);
+    int Find(int Index);
+
+    TPartReq *FReq;
+    long long FStartSector;
+    int FFatSectors;
+
+    int FWindowSectors;
+    int FWindowCount;
+    struct TFatCacheWindow *FWindowArr;
+
+    int FHashArr[FAT_CACHE_HASH_SIZE];
+
+    int FHead;
+    int FTail;
+
+    unsigned int FHits;
+    unsigned int FMisses;
+    unsigned int FPrefetches;
+};
+
+#endif
@@ -80,7 +80,6 @@ TFatDir::TFatDir(TFat *Fat, TDir *ParentDir, int ParentIndex, unsigned int Clust
     FClusterChain = Fat->GetClusterChain(Cluster);
 
     FClusterCount = FClusterChain->GetSize();
-    FClusterArr = FClusterChain->GetChain();
 
     FSectorsPerCluster = Fat->SectorsPerCluster;
     FStartSector = Fat->StartSector;
@@ -580,7 +579,7 @@ void TFatDir::ProcessClusters()
     int pos = 1;
 
     for (i = 0; i < FClusterCount; i++)
-        ProcessCluster(FClusterArr[i], &pos);
+        ProcessCluster(FClusterChain->Get(i), &pos);
 }
 
 /*##########################################################################
@@ -634,7 +633,7 @@ unsigned int TFatDir::GetCluster(int index)
 {
     if (FClusterChain)
         if (index < FClusterCount)
-            return FClusterArr[index];
+            return FClusterChain->Get(index);
 
     return 0;
 }
@@ -665,7 +664,7 @@ long long TFatDir::GetSector(int pos)
             cluster = entry / FSectorsPerCluster;
             entry = entry % FSectorsPerCluster;
             if (cluster < FClusterCount)
-                return FStartSector + (FClusterArr[cluster] - 2) * FSectorsPerCluster + entry;
+                return FStartSector + (FClusterChain->Get(cluster) - 2) * FSectorsPerCluster + entry;
         }
         else
         {
@@ -101,7 +101,6 @@ protected:
 
     int FSectorsPerCluster;
     int FClusterCount;
-    unsigned int *FClusterArr;
 
     TFat *FFat;
     TCluster *FClusterChain;
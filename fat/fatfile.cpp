@@ -51,13 +51,125 @@ TFatFile::TFatFile(TFat *Fat, TDir *ParentDir, int ParentIndex, unsigned int Clu
   : TFile(ParentDir, ParentIndex, BytesPerSector, OffsetSector)
 {
     unsigned int NeededClusters;
-    FFat = Fat;
-    struct RdosDirEntry *entry;
-    FClusterChain = Fat->GetClusterChain(Cluster);
 
+    FFat = Fat;
     FSectorsPerCluster = Fat->SectorsPerCluster;
-    FClusterCount = FClusterChain->GetSize();
-    FClusterArr = FClusterChain->GetChain();
+    FClusterChain = new TCluster;
+    FClusterCount = 0;
+    FNextCluster = Cluster;
+    FSizeChecked = false;
+    FPrealloc = 0;
+
+    if (!ResolveChain(1))
+    {
+        NeededClusters = SizeToClusters(Info->CurrSize);
+        Info->SectorCount = (long long)NeededClusters * FSectorsPerCluster;
+        Info->DiscSize = ClustersToSize(NeededClusters);
+
+        Fat->AddLazy(this);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::~TFatFile
+#
+#   Purpose....: Fat file destructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatFile::~TFatFile()
+{
+    FFat->RemoveLazy(this);
+
+    TrimPrealloc();
+    FFat->ReleaseChain(FClusterChain);
+    delete FClusterChain;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::ResolveChain
+#
+#   Purpose....: Read more of the cluster chain, until it holds Count
+#                clusters or is complete. The size check is done when the
+#                chain becomes complete
+#
+#   In params..: Count      Wanted number of clusters
+#   Out params.: *
+#   Returns....: true if the chain is complete
+#
+##########################################################################*/
+bool TFatFile::ResolveChain(unsigned int Count)
+{
+    if (FNextCluster)
+    {
+        FFat->ExtendClusterChain(FClusterChain, &FNextCluster, Count);
+        FClusterCount = FClusterChain->GetSize();
+    }
+
+    if (FNextCluster)
+        return false;
+
+    if (!FSizeChecked)
+    {
+        FSizeChecked = true;
+        CheckSize();
+    }
+
+    return true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::GetClusterCount
+#
+#   Purpose....: Get number of resolved clusters
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatFile::GetClusterCount()
+{
+    return FClusterCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::CompleteChain
+#
+#   Purpose....: Read the rest of the cluster chain
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatFile::CompleteChain()
+{
+    ResolveChain(FFat->Clusters);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::CheckSize
+#
+#   Purpose....: Check file size against complete cluster chain
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatFile::CheckSize()
+{
+    unsigned int NeededClusters;
+    struct RdosDirEntry *entry;
 
     NeededClusters = SizeToClusters(Info->CurrSize);
 
@@ -68,7 +180,7 @@ TFatFile::TFatFile(TFat *Fat, TDir *ParentDir, int ParentIndex, unsigned int Clu
         entry = FParent->LockEntry(FParentIndex);
         if (entry)
         {
-            entry->Inode = FClusterArr[0];
+            entry->Inode = FClusterChain->Get(0);
             FParent->UpdateEntry(entry, Info);
             FParent->UnlockEntry(entry);
         }
@@ -80,28 +192,11 @@ TFatFile::TFatFile(TFat *Fat, TDir *ParentDir, int ParentIndex, unsigned int Clu
     }
 
     FClusterCount = FClusterChain->GetSize();
-    FClusterArr = FClusterChain->GetChain();
 
     Info->SectorCount = (long long)(FClusterCount * FSectorsPerCluster);
     Info->DiscSize = ClustersToSize(FClusterCount);
 }
 
-/*##########################################################################
-#
-#   Name       : TFatFile::~TFatFile
-#
-#   Purpose....: Fat file destructor
-#
-#   In params..: *
-#   Out params.: *
-#   Returns....: *
-#
-##########################################################################*/
-TFatFile::~TFatFile()
-{
-    delete FClusterChain;
-}
-
 /*##########################################################################
 #
 #   Name       : TFatFile::SetRead
@@ -120,6 +215,11 @@ void TFatFile::SetRead(long long StartSector, int Sectors)
     int count;
     long long c;
 
+    c = (StartSector + Sectors - 1) / FSectorsPerCluster;
+
+    if (FNextCluster && c >= FClusterCount)
+        ResolveChain((unsigned int)c + 1);
+
     c = StartSector / FSectorsPerCluster;
 
     if (c >= FClusterCount)
@@ -170,6 +270,9 @@ void TFatFile::SetWrite(long long StartSector, int Sectors)
     {
         c = (StartSector + Sectors - 1) / FSectorsPerCluster;
 
+        if (FNextCluster && c >= FClusterCount)
+            ResolveChain((unsigned int)c + 1);
+
         if (c >= FClusterCount)
             c = FClusterCount - 1;
 
@@ -185,7 +288,7 @@ void TFatFile::SetWrite(long long StartSector, int Sectors)
         {
             for (i = 1; i <= count; i++)
             {
-                if (FFat->IsFree(FClusterArr[c] + i))
+                if (FFat->IsFree(FClusterChain->Get((unsigned int)c) + i))
                     end =  (c + i) * FSectorsPerCluster + offset - 1 - FSectorsPerPage;
                 else
                     break;
@@ -219,12 +322,15 @@ long long TFatFile::GetSector(long long RelSector)
     unsigned int cluster;
     long long sector;
 
-    if (c < FClusterCount)
-        return FFat->StartSector + (FClusterArr[c] - 2) * sc + diff;
+    if (FNextCluster && c >= FClusterCount)
+        ResolveChain(c + 1);
+
+    if (c < FClusterChain->GetSize())
+        return FFat->StartSector + (FClusterChain->Get(c) - 2) * sc + diff;
     else
     {
-        count = c - FClusterCount + 1;
-        cluster = FClusterArr[FClusterCount - 1];
+        count = c - FClusterChain->GetSize() + 1;
+        cluster = FClusterChain->GetLast();
         sector = FFat->StartSector + (cluster - 2) * sc + diff;
 
         for (i = 0; i < count; i++)
@@ -241,6 +347,42 @@ long long TFatFile::GetSector(long long RelSector)
     }
 }
 
+/*##########################################################################
+#
+#   Name       : TFatFile::GetExtent
+#
+#   Purpose....: Get sector of position, and the file sectors that are
+#                contiguous on disc with it. The range is taken from the
+#                cluster chain extent that holds the position
+#
+#   In params..: RelSector      File sector
+#   Out params.: Start          First file sector of extent
+#                Count          Sectors in extent
+#   Returns....: Disc sector of RelSector
+#
+##########################################################################*/
+long long TFatFile::GetExtent(long long RelSector, long long *Start, long long *Count)
+{
+    unsigned int c = (unsigned int)(RelSector / FSectorsPerCluster);
+    int diff = (int)(RelSector % FSectorsPerCluster);
+    struct TClusterExtent Ext;
+
+    if (FNextCluster && c >= FClusterCount)
+        ResolveChain(c + 1);
+
+    if (!FClusterChain->Lookup(c, &Ext))
+    {
+        *Start = RelSector;
+        *Count = 1;
+        return GetSector(RelSector);
+    }
+
+    *Start = (long long)Ext.Pos * FSectorsPerCluster;
+    *Count = (long long)Ext.Count * FSectorsPerCluster;
+
+    return FFat->StartSector + (long long)(Ext.Cluster - 2 + c - Ext.Pos) * FSectorsPerCluster + diff;
+}
+
 /*##########################################################################
 #
 #   Name       : TFatFile::SizeToClusters
@@ -287,7 +429,8 @@ long long TFatFile::ClustersToSize(unsigned int clusters)
 #
 #   Name       : TFatFile::Grow
 #
-#   Purpose....: Grow file with new clusters
+#   Purpose....: Grow file with new clusters. An empty file is placed
+#                near its parent directory
 #
 #   In params..: *
 #   Out params.: *
@@ -299,23 +442,25 @@ bool TFatFile::Grow(unsigned int count)
     struct RdosDirEntry *entry;
     bool ok;
     bool update;
-    unsigned int *Arr;
+    unsigned int hint = 0;
 
     if (FClusterChain->GetSize())
         update = false;
     else
+    {
         update = true;
+        if (FParent)
+            hint = ((TFatDir *)FParent)->GetCluster(0);
+    }
 
-    ok = FFat->GrowClusterChain(FClusterChain, count);
+    ok = FFat->GrowClusterChain(FClusterChain, count, hint);
 
     if (FParent && update && FClusterChain->GetSize())
     {
-        Arr = FClusterChain->GetChain();
-
         entry = FParent->LockEntry(FParentIndex);
         if (entry)
         {
-            entry->Inode = Arr[0];
+            entry->Inode = FClusterChain->Get(0);
             FParent->UpdateEntry(entry, Info);
             FParent->UnlockEntry(entry);
         }
@@ -375,15 +520,15 @@ bool TFatFile::Shrink(unsigned int count)
 ##########################################################################*/
 bool TFatFile::GrowDisc(long long Size)
 {
-    unsigned int CurrClusters;
     unsigned int NewClusters;
     bool ok;
 
+    CompleteChain();
+
     if (Size > 0xFFFFFFFF)
         ok = false;
     else
     {
-        CurrClusters = FClusterChain->GetSize();
         NewClusters = SizeToClusters(Size);
         ok = true;
     }
@@ -392,11 +537,9 @@ bool TFatFile::GrowDisc(long long Size)
 
     if (ok)
     {
-        if (NewClusters > CurrClusters)
-            ok = Grow(NewClusters - CurrClusters);        
+        if (NewClusters > FClusterCount)
+            ok = Reserve(NewClusters);
 
-        FClusterCount = FClusterChain->GetSize();
-        FClusterArr = FClusterChain->GetChain();
         Info->SectorCount = (long long)(FClusterCount * FSectorsPerCluster);
         Info->DiscSize = ClustersToSize(FClusterCount);
     }
@@ -423,6 +566,8 @@ bool TFatFile::SetDiscSize(long long Size)
     unsigned int NewClusters;
     bool ok;
 
+    CompleteChain();
+
     if (Size > 0xFFFFFFFF)
         ok = false;
     else
@@ -436,16 +581,18 @@ bool TFatFile::SetDiscSize(long long Size)
 
     if (ok)
     {
-        if (NewClusters > CurrClusters)
-            ok = Grow(NewClusters - CurrClusters);
+        if (NewClusters > FClusterCount)
+            ok = Reserve(NewClusters);
         else
         {
-            if (NewClusters < CurrClusters)
+            if (NewClusters < FClusterCount)
+            {
                 ok = Shrink(CurrClusters - NewClusters);
+                FClusterCount = FClusterChain->GetSize();
+                FPrealloc = 0;
+            }
         }
 
-        FClusterCount = FClusterChain->GetSize();
-        FClusterArr = FClusterChain->GetChain();
         Info->SectorCount = (long long)(FClusterCount * FSectorsPerCluster);
         Info->DiscSize = ClustersToSize(FClusterCount);
     }
@@ -454,3 +601,126 @@ bool TFatFile::SetDiscSize(long long Size)
 
     return ok;
 }
+
+/*##########################################################################
+#
+#   Name       : TFatFile::ReserveDisc
+#
+#   Purpose....: Reserve clusters for file without changing its size.
+#                The chain grows in contiguous runs where possible. The
+#                clusters are not mapped, so they are never zeroed, and
+#                they are kept until the file is closed or truncated
+#
+#   In params..: Size           Bytes to reserve from start of file
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatFile::ReserveDisc(long long Size)
+{
+    unsigned int CurrClusters;
+    unsigned int NewClusters;
+    bool ok = true;
+
+    if (Size > 0xFFFFFFFF)
+        return false;
+
+    CompleteChain();
+
+    LockFile();
+
+    CurrClusters = FClusterChain->GetSize();
+    NewClusters = SizeToClusters(Size);
+
+    if (NewClusters > CurrClusters)
+        ok = Grow(NewClusters - CurrClusters);
+
+    UnlockFile();
+
+    return ok;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::NextPrealloc
+#
+#   Purpose....: Get size of next speculative preallocation. It doubles
+#                for every grow, up to the mount limit
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: Clusters to reserve beyond the wanted size
+#
+##########################################################################*/
+unsigned int TFatFile::NextPrealloc()
+{
+    unsigned int Max;
+
+    Max = (unsigned int)(((long long)FatOptions.Prealloc << 10) / FSectorsPerCluster / FBytesPerSector);
+
+    if (FPrealloc)
+        FPrealloc = 2 * FPrealloc;
+    else
+        FPrealloc = 1;
+
+    if (FPrealloc > Max)
+        FPrealloc = Max;
+
+    return FPrealloc;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::Reserve
+#
+#   Purpose....: Make Clusters visible. Clusters already reserved are
+#                used first. Otherwise the chain grows with a speculative
+#                preallocation that is not part of the file size
+#
+#   In params..: Clusters       Wanted visible clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatFile::Reserve(unsigned int Clusters)
+{
+    unsigned int Size = FClusterChain->GetSize();
+    bool ok = true;
+
+    if (Clusters > Size)
+    {
+        ok = Grow(Clusters - Size + NextPrealloc());
+
+        Size = FClusterChain->GetSize();
+        if (Size >= Clusters)
+            ok = true;
+    }
+
+    if (Clusters > Size)
+        FClusterCount = Size;
+    else
+        FClusterCount = Clusters;
+
+    return ok;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatFile::TrimPrealloc
+#
+#   Purpose....: Free reserved clusters beyond the file size
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatFile::TrimPrealloc()
+{
+    unsigned int Size = FClusterChain->GetSize();
+
+    if (!FNextCluster && Size > FClusterCount)
+        Shrink(Size - FClusterCount);
+
+    FPrealloc = 0;
+}
@@ -47,9 +47,15 @@ public:
     virtual void SetRead(long long StartSector, int Sectors);
     virtual void SetWrite(long long StartSector, int Sectors);
     virtual long long GetSector(long long RelSector);
+    virtual long long GetExtent(long long RelSector, long long *Start, long long *Count);
 
     virtual bool GrowDisc(long long Size);
     virtual bool SetDiscSize(long long Size);
+    virtual bool ReserveDisc(long long Size);
+
+    bool ResolveChain(unsigned int Count);
+    void TrimPrealloc();
+    unsigned int GetClusterCount();
 
 protected:
     unsigned int SizeToClusters(long long size);
@@ -57,10 +63,16 @@ protected:
 
     bool Grow(unsigned int count);
     bool Shrink(unsigned int count);
+    void CompleteChain();
+    bool Reserve(unsigned int Clusters);
+    unsigned int NextPrealloc();
+    void CheckSize();
 
     int FSectorsPerCluster;
     int FClusterCount;
-    unsigned int *FClusterArr;
+    unsigned int FNextCluster;
+    bool FSizeChecked;
+    unsigned int FPrealloc;
 
     TFat *FFat;
     TCluster *FClusterChain;
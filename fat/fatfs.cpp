@@ -43,6 +43,38 @@
 #include "cluster.h"
 #include "fatfile.h"
 
+/*##########################################################################
+#
+#   Name       : FlushStartup
+#
+#   Purpose....: Startup procedure for flush thread
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void FlushStartup(void *ptr)
+{
+    ((TFat *)ptr)->ExecuteFlush();
+}
+
+/*##########################################################################
+#
+#   Name       : ScanStartup
+#
+#   Purpose....: Startup procedure for free cluster scan thread
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void ScanStartup(void *ptr)
+{
+    ((TFat *)ptr)->ExecuteScan();
+}
+
 /*##########################################################################
 #
 #   Name       : TFat::TFat
@@ -55,14 +87,49 @@
 #
 ##########################################################################*/
 TFat::TFat(TPartServer *server, struct TBaseBootSector *boot)
-  : TFs(server)
+  : TFs(server),
+    FSection("FAT"),
+    FLazySection("FAT Lazy")
 {
+    int i;
+
     FatCount = boot->FatCount;
     SectorsPerCluster = boot->SectorsPerCluster;
     ReservedSectors = boot->ResvSectors;
 
     FatTable1 = 0;
     FatTable2 = 0;
+    FreeClusters = 0;
+
+    FFlushActive = false;
+    FMirror = FatOptions.Mirror;
+
+    FScan = 0;
+    FScanTables = false;
+    FScanPending = false;
+    FScanActive = false;
+
+    FModified = false;
+    FClean = true;
+
+    FLazyArr = 0;
+    FLazyCount = 0;
+    FLazySize = 0;
+    FLazyNext = 0;
+
+    for (i = 0; i < FS_MAX_WORKERS; i++)
+        FLazyBusy[i] = 0;
+
+    for (i = 0; i < FAT_ALLOC_CURSORS; i++)
+    {
+        FAllocArr[i].Chain = 0;
+        FAllocArr[i].Group = 0;
+    }
+    FAllocNext = 0;
+
+    SetWorkers(FatOptions.Workers);
+    SetQueueSize(FatOptions.QueueSize);
+    SetReadAhead(FatOptions.ReadAhead);
 }
 
 /*##########################################################################
@@ -77,6 +144,336 @@ TFat::TFat(TPartServer *server, struct TBaseBootSector *boot)
 #
 ##########################################################################*/
 TFat::~TFat()
+{
+    if (FLazyArr)
+        delete FLazyArr;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::Run
+#
+#   Purpose....: Run. Starts thread that flushes dirty FAT sectors, and
+#                thread that counts free clusters if this is pending
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::Run()
+{
+    char ThreadName[40];
+    int Handle = FServer->GetHandle();
+    int Disc = ServGetVfsDisc(Handle);
+    int Part = ServGetVfsPart(Handle);
+
+    if (!FStopped)
+    {
+        FFlushActive = true;
+        sprintf(ThreadName, "FAT Flush %02hX.%02hX", Disc, Part);
+        RdosCreateThread(FlushStartup, ThreadName, this, 0x2000);
+
+        if (FScanPending)
+        {
+            FScanActive = true;
+            sprintf(ThreadName, "FAT Scan %02hX.%02hX", Disc, Part);
+            RdosCreateThread(ScanStartup, ThreadName, this, 0x2000);
+        }
+    }
+
+    TFs::Run();
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::Stop
+#
+#   Purpose....: Stop server, trim preallocations of open files, write
+#                remaining dirty FAT sectors and set the clean shutdown
+#                flag
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::Stop()
+{
+    int i;
+
+    TFs::Stop();
+
+    FSection.Enter();
+    if (FScan)
+        FScan->Abort();
+    FSection.Leave();
+
+    while (FFlushActive || FScanActive)
+        RdosWaitMilli(50);
+
+    if (FatTable1 && FatTable2)
+    {
+        for (i = 0; i < FMaxFileCount; i++)
+            if (FFileArr[i])
+                ((TFatFile *)FFileArr[i])->TrimPrealloc();
+
+        FSection.Enter();
+
+        if (!FClean)
+        {
+            FClean = true;
+            FModified = true;
+            FatTable1->SetClean(true);
+            if (!FMirror)
+                FatTable2->SetClean(true);
+        }
+
+        FSection.Leave();
+
+        Complete();
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::ExecuteFlush
+#
+#   Purpose....: Flush thread. Writes dirty FAT sectors periodically
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::ExecuteFlush()
+{
+    int Elapsed = 0;
+
+    while (!FStopped)
+    {
+        RdosWaitMilli(50);
+        Elapsed += 50;
+
+        if (Elapsed >= FatOptions.FlushInterval && !FStopped)
+        {
+            Complete();
+            Elapsed = 0;
+        }
+    }
+
+    FFlushActive = false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::ExecuteScan
+#
+#   Purpose....: Free cluster scan thread
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::ExecuteScan()
+{
+    CompleteScan(FAT_SCAN_BACKGROUND_DEPTH);
+    FScanActive = false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::SetupScan
+#
+#   Purpose....: Prepare tables for free cluster scan. Allocation works
+#                while the scan runs: below the scan position the bitmap
+#                is used, and above it the table is searched directly.
+#                The scan is done here if the volume was not cleanly
+#                unmounted, or with the mount scan option
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::SetupScan()
+{
+    unsigned int Free1;
+    unsigned int Free2;
+
+    FClean = FatTable1->IsClean();
+
+    FatTable1->BeginScan();
+
+    if (!FMirror)
+        FatTable2->BeginScan();
+
+    FScanTables = true;
+
+    if (FClean)
+    {
+        printf("FAT clean, fast mount\r\n");
+
+        if (FatOptions.BackgroundScan)
+            FScanPending = true;
+        else
+            CompleteScan(FAT_SCAN_DEPTH);
+    }
+    else
+    {
+        printf("FAT not cleanly unmounted, full scan\r\n");
+
+        FreeClusters = 0;
+        CompleteScan(FAT_SCAN_DEPTH);
+
+        if (!FMirror)
+        {
+            Free1 = FatTable1->GetFreeCount();
+            Free2 = FatTable2->GetFreeCount();
+
+            if (Free1 != Free2)
+                printf("FAT1 / FAT2 free clusters differ: %d / %d\r\n", Free1, Free2);
+        }
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::CompleteScan
+#
+#   Purpose....: Count free clusters. In mirror mode, FAT2 blocks that
+#                differ from FAT1 are updated. The background scan uses
+#                a small depth, so it leaves reqs for file I/O. Without
+#                any req, the tables stay unscanned and allocation reads
+#                the tables directly
+#
+#   In params..: Depth          Blocks in flight
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::CompleteScan(int Depth)
+{
+    TFatScan Scan(FServer, Depth);
+    int Synced;
+
+    if (!Scan.IsValid())
+    {
+        printf("FAT scan: no disc req available\r\n");
+        return;
+    }
+
+    if (FMirror)
+        Scan.Add(FatTable1, Fat2Sector);
+    else
+    {
+        Scan.Add(FatTable1);
+        Scan.Add(FatTable2);
+    }
+
+    FSection.Enter();
+    FScan = &Scan;
+    FScanPending = false;
+    if (FStopped)
+        Scan.Abort();
+    FSection.Leave();
+
+    Scan.SetSection(&FSection);
+    Scan.Run();
+
+    FSection.Enter();
+    FScan = 0;
+    FSection.Leave();
+
+    Synced = Scan.GetSynced();
+    if (Synced)
+        printf("FAT2 updated from FAT1: %d sectors\r\n", Synced);
+
+    if (FatTable1->IsScanned())
+    {
+        FreeClusters = (unsigned int)(GetFreeSectors() / SectorsPerCluster);
+        printf("FAT free clusters: %d\r\n", FreeClusters);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::GetScannedFree
+#
+#   Purpose....: Get free clusters from tables. Caller must be inside
+#                the FAT section
+#
+#   In params..: *
+#   Out params.: Free           Free clusters
+#   Returns....: true if the free cluster scan is done
+#
+##########################################################################*/
+bool TFat::GetScannedFree(unsigned int *Free)
+{
+    unsigned int Free2;
+
+    *Free = FatTable1->GetFreeCount();
+
+    if (!FatTable1->IsScanned())
+        return false;
+
+    if (!FMirror)
+    {
+        Free2 = FatTable2->GetFreeCount();
+        if (Free2 < *Free)
+            *Free = Free2;
+
+        if (!FatTable2->IsScanned())
+            return false;
+    }
+
+    return true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::BeginModify
+#
+#   Purpose....: Called inside the FAT section before tables are
+#                changed. The first change clears the clean shutdown
+#                flag, and the first change after a flush marks the
+#                free cluster info as not valid
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::BeginModify()
+{
+    if (FClean)
+    {
+        FClean = false;
+        FatTable1->SetClean(false);
+        if (!FMirror)
+            FatTable2->SetClean(false);
+    }
+
+    if (!FModified)
+    {
+        FModified = true;
+        UpdateInfo(false);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::UpdateInfo
+#
+#   Purpose....: Update free cluster info on disc. Only FAT32 has one
+#
+#   In params..: Valid          Tables are flushed, and info is valid
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::UpdateInfo(bool Valid)
 {
 }
 
@@ -132,7 +529,8 @@ int TFat::Format(long long *Start, long long *Count)
 #
 #   Name       : TFat::GetFreeSectors
 #
-#   Purpose....: Get free sectors
+#   Purpose....: Get free sectors. While the free cluster scan runs,
+#                this is an estimate from FSInfo or the scanned part
 #
 #   In params..: *
 #   Out params.: *
@@ -141,7 +539,37 @@ int TFat::Format(long long *Start, long long *Count)
 ##########################################################################*/
 long long TFat::GetFreeSectors()
 {
-    return (long long)FreeClusters * (long long)SectorsPerCluster;
+    unsigned int Free;
+    unsigned int Scanned;
+    bool Done;
+
+    if (!FScanTables)
+        return (long long)FreeClusters * (long long)SectorsPerCluster;
+
+    FSection.Enter();
+
+    Done = GetScannedFree(&Free);
+
+    Scanned = FatTable1->GetScanCluster();
+    if (!FMirror && FatTable2->GetScanCluster() < Scanned)
+        Scanned = FatTable2->GetScanCluster();
+
+    FSection.Leave();
+
+    if (!Done)
+    {
+        if (FreeClusters)
+            Free = FreeClusters;
+        else
+        {
+            if (Scanned)
+                Free = (unsigned int)((long long)Free * Clusters / Scanned);
+            else
+                Free = Clusters;
+        }
+    }
+
+    return (long long)Free * (long long)SectorsPerCluster;
 }
 
 /*##########################################################################
@@ -207,7 +635,7 @@ TDir *TFat::CacheDir(TDir *ParentDir, int ParentIndex, long long Inode)
 #
 #   Name       : TFat::GetClusterChain
 #
-#   Purpose....: Get cluster chain
+#   Purpose....: Get complete cluster chain
 #
 #   In params..: *
 #   Out params.: *
@@ -216,91 +644,331 @@ TDir *TFat::CacheDir(TDir *ParentDir, int ParentIndex, long long Inode)
 ##########################################################################*/
 TCluster *TFat::GetClusterChain(unsigned int Cluster)
 {
-    TPartReq Req(FServer);
     TCluster *Chain;
+
+    Chain = new TCluster;
+    ExtendClusterChain(Chain, &Cluster, Clusters);
+
+    return Chain;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::ExtendClusterChain
+#
+#   Purpose....: Extend a partially read cluster chain until it holds
+#                Count clusters or the end is reached. The chain is read
+#                one contiguous run at a time. Without mirror mode, the
+#                FATs are compared run by run, and a difference is
+#                resolved at the first cluster where the links differ
+#
+#   In params..: Chain      Chain to extend
+#                Next       First unread cluster, updated
+#                Count      Wanted chain size
+#   Out params.: *
+#   Returns....: true if the chain is complete (Next is then 0)
+#
+##########################################################################*/
+bool TFat::ExtendClusterChain(TCluster *Chain, unsigned int *Next, unsigned int Count)
+{
+    unsigned int Cluster;
     unsigned int NextCluster1;
     unsigned int NextCluster2;
+    unsigned int Count1;
+    unsigned int Count2;
+    bool done = false;
 
-    Chain = new TCluster;
+    FSection.Enter();
 
-    while (Cluster && Cluster < Clusters)
+    Cluster = *Next;
+
+    while (Chain->GetSize() < Count && !done)
     {
-        Chain->Add(Cluster);
+        if (!Cluster || Cluster >= Clusters || Chain->GetSize() >= Clusters)
+        {
+            done = true;
+            continue;
+        }
+
+        NextCluster1 = FatTable1->GetRun(Cluster, &Count1);
+
+        if (FMirror)
+        {
+            Chain->AddRun(Cluster, Count1);
+            Cluster = NextCluster1;
+            continue;
+        }
+
+        NextCluster2 = FatTable2->GetRun(Cluster, &Count2);
+
+        if (Count1 > Count2)
+        {
+            NextCluster1 = Cluster + Count2;
+            Count1 = Count2;
+        }
+
+        if (Count2 > Count1)
+            NextCluster2 = Cluster + Count1;
 
-        NextCluster1 = FatTable1->GetClusterLink(Cluster);
-        NextCluster2 = FatTable2->GetClusterLink(Cluster);
+        Chain->AddRun(Cluster, Count1);
 
         if (NextCluster1 == NextCluster2)
             Cluster = NextCluster1;
         else
         {
             if (NextCluster1 >= Clusters && NextCluster2 >= Clusters)
-                break;
+                done = true;
+            else
+            {
+                if (NextCluster1 < Clusters && NextCluster2 < Clusters)
+                    done = true;
+                else
+                {
+                    if (NextCluster1 > NextCluster2)
+                        Cluster = NextCluster2;
+                    else
+                        Cluster = NextCluster1;
+                }
+            }
+        }
+    }
 
-            if (NextCluster1 < Clusters && NextCluster2 < Clusters)
-                break;
+    if (!done && (!Cluster || Cluster >= Clusters))
+        done = true;
 
-            if (NextCluster1 > NextCluster2)
-                Cluster = NextCluster2;
-            else
-                Cluster = NextCluster1;
+    if (done)
+        *Next = 0;
+    else
+        *Next = Cluster;
+
+    FSection.Leave();
+
+    return done;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::AddLazy
+#
+#   Purpose....: Add file with partially read cluster chain
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::AddLazy(TFatFile *File)
+{
+    int i;
+    TFatFile **NewArr;
+
+    FLazySection.Enter();
+
+    if (FLazyCount == FLazySize)
+    {
+        if (FLazySize)
+            FLazySize = 2 * FLazySize;
+        else
+            FLazySize = 8;
+
+        NewArr = new TFatFile*[FLazySize];
+
+        for (i = 0; i < FLazyCount; i++)
+            NewArr[i] = FLazyArr[i];
+
+        if (FLazyArr)
+            delete FLazyArr;
+
+        FLazyArr = NewArr;
+    }
+
+    FLazyArr[FLazyCount] = File;
+    FLazyCount++;
+
+    FLazySection.Leave();
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::RemoveLazy
+#
+#   Purpose....: Remove file with partially read cluster chain. Waits
+#                if a worker is reading the chain of the file
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::RemoveLazy(TFatFile *File)
+{
+    int i;
+
+    FLazySection.Enter();
+
+    for (i = 0; i < FS_MAX_WORKERS; i++)
+    {
+        while (FLazyBusy[i] == File)
+        {
+            FLazySection.Leave();
+            RdosWaitMilli(1);
+            FLazySection.Enter();
         }
     }
 
-    return Chain;
+    for (i = 0; i < FLazyCount; i++)
+    {
+        if (FLazyArr[i] == File)
+        {
+            FLazyCount--;
+            FLazyArr[i] = FLazyArr[FLazyCount];
+            break;
+        }
+    }
+
+    FLazySection.Leave();
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::Idle
+#
+#   Purpose....: Read another part of a partially read cluster chain when
+#                the queue of a worker is empty. Files of the worker are
+#                served round-robin. The file is marked busy, and the
+#                chain is read outside the section, since reading it can
+#                lock the directory entry
+#
+#   In params..: Worker         Worker id
+#   Out params.: *
+#   Returns....: true if more chains are pending
+#
+##########################################################################*/
+bool TFat::Idle(int Worker)
+{
+    TFatFile *File = 0;
+    bool done;
+    int i;
+
+    FLazySection.Enter();
+
+    if (FLazyNext >= FLazyCount)
+        FLazyNext = 0;
+
+    for (i = 0; i < FLazyCount && !File && !FStopped; i++)
+    {
+        if (GetWorker(FLazyArr[FLazyNext]) == Worker)
+        {
+            File = FLazyArr[FLazyNext];
+            FLazyBusy[Worker] = File;
+        }
+
+        FLazyNext++;
+        if (FLazyNext >= FLazyCount)
+            FLazyNext = 0;
+    }
+
+    FLazySection.Leave();
+
+    if (!File)
+        return false;
+
+    done = File->ResolveChain(File->GetClusterCount() + FAT_LAZY_CLUSTERS);
+
+    FLazySection.Enter();
+
+    FLazyBusy[Worker] = 0;
+
+    if (done)
+    {
+        for (i = 0; i < FLazyCount; i++)
+        {
+            if (FLazyArr[i] == File)
+            {
+                FLazyCount--;
+                FLazyArr[i] = FLazyArr[FLazyCount];
+                break;
+            }
+        }
+    }
+
+    FLazySection.Leave();
+
+    return true;
 }
 
 /*##########################################################################
 #
 #   Name       : TFat::GrowClusterChain
 #
-#   Purpose....: Grow cluster chain
+#   Purpose....: Grow cluster chain. A chain continues after its last
+#                cluster. An empty chain is placed near Hint, in an
+#                allocation group no other growing chain uses
 #
 #   In params..: *
 #   Out params.: *
 #   Returns....: *
 #
 ##########################################################################*/
-bool TFat::GrowClusterChain(TCluster *Chain, unsigned int Count)
+bool TFat::GrowClusterChain(TCluster *Chain, unsigned int Count, unsigned int Hint)
 {
-    int i;
     bool ok = true;
     unsigned int cluster;
     unsigned int link;
-    int size;
-    unsigned int *arr;
+    unsigned int run;
+
+    FSection.Enter();
 
-    size = Chain->GetSize();
-    if (size)
+    if (Count)
+        BeginModify();
+
+    if (Chain->GetSize())
+    {
+        cluster = Chain->GetLast();
+        FatTable1->SetAllocateCluster(cluster + 1);
+        if (!FMirror)
+            FatTable2->SetAllocateCluster(cluster + 1);
+    }
+    else
     {
-        arr = Chain->GetChain();
-        cluster = arr[size - 1];
-        FatTable1->SetAllocateCluster(cluster);
-        FatTable2->SetAllocateCluster(cluster);
+        if (Hint && Count)
+        {
+            cluster = PlaceChain(Chain, Hint);
+            FatTable1->SetAllocateCluster(cluster);
+            if (!FMirror)
+                FatTable2->SetAllocateCluster(cluster);
+        }
     }
 
-    for (i = 0; i < Count && ok; i++)
+    while (Count && ok)
     {
-        cluster = AllocateCluster();
+        cluster = AllocateRun(Count, &run);
         if (cluster)
         {
-            size = Chain->GetSize();
-            if (size)
+            if (Chain->GetSize())
             {
-                arr = Chain->GetChain();
-                link = arr[size - 1];
+                link = Chain->GetLast();
                 FatTable1->LinkCluster(link, cluster);
-                FatTable2->LinkCluster(link, cluster);
+                if (!FMirror)
+                    FatTable2->LinkCluster(link, cluster);
             }
 
-            Chain->Add(cluster);
+            FatTable1->LinkRun(cluster, run);
+            if (!FMirror)
+                FatTable2->LinkRun(cluster, run);
+
+            Chain->AddRun(cluster, run);
+
+            Count -= run;
         }
         else
             ok = false;
     }
 
-    FatTable1->Complete();
-    FatTable2->Complete();
+    if (Chain->GetSize())
+        SetActiveGroup(Chain);
+
+    FSection.Leave();
 
     return ok;
 }
@@ -309,7 +977,8 @@ bool TFat::GrowClusterChain(TCluster *Chain, unsigned int Count)
 #
 #   Name       : TFat::ShrinkClusterChain
 #
-#   Purpose....: Shrink cluster chain
+#   Purpose....: Shrink cluster chain. The tail is freed one extent at
+#                a time
 #
 #   In params..: *
 #   Out params.: *
@@ -318,43 +987,171 @@ bool TFat::GrowClusterChain(TCluster *Chain, unsigned int Count)
 ##########################################################################*/
 bool TFat::ShrinkClusterChain(TCluster *Chain, unsigned int Count)
 {
-    int i;
     bool ok = true;
     unsigned int cluster;
-    int pos;
-    unsigned int *arr;
+    unsigned int run;
+    struct TClusterExtent Ext;
 
-    for (i = 0; i < Count && ok; i++)
+    FSection.Enter();
+
+    BeginModify();
+
+    while (Count && ok)
     {
-        pos = Chain->GetSize();
-        if (pos)
+        if (Chain->GetLastExtent(&Ext))
         {
-            arr = Chain->GetChain();
-            cluster = arr[pos - 1];
-            FatTable1->FreeCluster(cluster);
-            FatTable2->FreeCluster(cluster);
+            run = Ext.Count;
+            if (run > Count)
+                run = Count;
+
+            cluster = Ext.Cluster + Ext.Count - run;
+
+            FatTable1->FreeRun(cluster, run);
+            if (!FMirror)
+                FatTable2->FreeRun(cluster, run);
 
-            Chain->Sub();
+            Chain->SubRun(run);
+            Count -= run;
         }
         else
             ok = false;
     }
 
-    pos = Chain->GetSize();
-    if (pos)
+    if (Chain->GetSize())
     {
-        arr = Chain->GetChain();
-        cluster = arr[pos - 1];
+        cluster = Chain->GetLast();
         FatTable1->LinkCluster(cluster);
-        FatTable2->LinkCluster(cluster);
+        if (!FMirror)
+            FatTable2->LinkCluster(cluster);
     }
 
-    FatTable1->Complete();
-    FatTable2->Complete();
+    FSection.Leave();
 
     return ok;
 }
 
+/*##########################################################################
+#
+#   Name       : TFat::PlaceChain
+#
+#   Purpose....: Find start cluster for an empty chain. The search starts
+#                in the allocation group of Hint and takes the first group
+#                with free clusters that no other growing chain uses
+#
+#   In params..: Chain          Chain to place
+#                Hint           Wanted cluster
+#   Out params.: *
+#   Returns....: Cluster to start allocation at
+#
+##########################################################################*/
+unsigned int TFat::PlaceChain(TCluster *Chain, unsigned int Hint)
+{
+    TFatBitmap *Bitmap = FatTable1->GetBitmap();
+    unsigned int Groups;
+    unsigned int Group;
+    unsigned int i;
+
+    if (!Bitmap->IsValid())
+        return Hint;
+
+    Groups = Bitmap->GetGroups();
+
+    for (i = 0; i < Groups; i++)
+    {
+        Group = ((Hint >> FAT_BITMAP_GROUP_SHIFT) + i) % Groups;
+
+        if (Bitmap->GetGroupFree(Group) && !IsActiveGroup(Chain, Group))
+        {
+            if (i == 0)
+                return Hint;
+
+            if (Group)
+                return Group << FAT_BITMAP_GROUP_SHIFT;
+            else
+                return 2;
+        }
+    }
+
+    return Hint;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::IsActiveGroup
+#
+#   Purpose....: Check if another growing chain uses allocation group
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFat::IsActiveGroup(TCluster *Chain, unsigned int Group)
+{
+    int i;
+
+    for (i = 0; i < FAT_ALLOC_CURSORS; i++)
+        if (FAllocArr[i].Chain && FAllocArr[i].Chain != Chain && FAllocArr[i].Group == Group)
+            return true;
+
+    return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::SetActiveGroup
+#
+#   Purpose....: Record allocation group of a growing chain. The oldest
+#                entry is replaced when all are used
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::SetActiveGroup(TCluster *Chain)
+{
+    int i;
+    unsigned int Group = Chain->GetLast() >> FAT_BITMAP_GROUP_SHIFT;
+
+    for (i = 0; i < FAT_ALLOC_CURSORS; i++)
+    {
+        if (FAllocArr[i].Chain == Chain)
+        {
+            FAllocArr[i].Group = Group;
+            return;
+        }
+    }
+
+    FAllocArr[FAllocNext].Chain = Chain;
+    FAllocArr[FAllocNext].Group = Group;
+    FAllocNext = (FAllocNext + 1) % FAT_ALLOC_CURSORS;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::ReleaseChain
+#
+#   Purpose....: Remove chain from allocation groups
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::ReleaseChain(TCluster *Chain)
+{
+    int i;
+
+    FSection.Enter();
+
+    for (i = 0; i < FAT_ALLOC_CURSORS; i++)
+        if (FAllocArr[i].Chain == Chain)
+            FAllocArr[i].Chain = 0;
+
+    FSection.Leave();
+}
+
 /*##########################################################################
 #
 #   Name       : TFat::SetClusterCount
@@ -371,7 +1168,7 @@ bool TFat::SetClusterCount(TCluster *Chain, unsigned int Clusters)
     int size = Chain->GetSize();
 
     if (Clusters > size)
-        return GrowClusterChain(Chain, Clusters - size);
+        return GrowClusterChain(Chain, Clusters - size, 0);
     else
         if (Clusters < size)
             return ShrinkClusterChain(Chain, size - Clusters);
@@ -401,7 +1198,8 @@ TFile *TFat::OpenFile(TDir *ParentDir, int ParentIndex, long long Inode)
 #
 #   Name       : TFat::IsFree
 #
-#   Purpose....: Check if cluster is free
+#   Purpose....: Check if cluster is free. Files of different I/O workers
+#                can check at the same time
 #
 #   In params..: *
 #   Out params.: *
@@ -410,13 +1208,52 @@ TFile *TFat::OpenFile(TDir *ParentDir, int ParentIndex, long long Inode)
 ##########################################################################*/
 bool TFat::IsFree(unsigned int Cluster)
 {
+    bool ok = true;
+
+    FSection.Enter();
+
     if (!FatTable1->IsFree(Cluster))
-        return false;
+        ok = false;
 
-    if (!FatTable2->IsFree(Cluster))
-        return false;
+    if (ok && !FMirror && !FatTable2->IsFree(Cluster))
+        ok = false;
 
-    return true;
+    FSection.Leave();
+
+    return ok;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::LogCacheStats
+#
+#   Purpose....: Log FAT cache and write statistics
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFat::LogCacheStats()
+{
+    TFatCache *Cache;
+    TFatModSet *ModSet;
+
+    Cache = FatTable1->GetCache();
+    ModSet = FatTable1->GetModSet();
+    printf("FAT1 cache: %d x %d sectors, hits: %u, misses: %u, prefetches: %u, writes: %u (%u sectors)\r\n",
+            Cache->GetWindowCount(), Cache->GetWindowSectors(),
+            Cache->GetHits(), Cache->GetMisses(), Cache->GetPrefetches(),
+            ModSet->GetWrites(), ModSet->GetWrittenSectors());
+
+    Cache = FatTable2->GetCache();
+    ModSet = FatTable2->GetModSet();
+    printf("FAT2 cache: %d x %d sectors, hits: %u, misses: %u, prefetches: %u, writes: %u (%u sectors)\r\n",
+            Cache->GetWindowCount(), Cache->GetWindowSectors(),
+            Cache->GetHits(), Cache->GetMisses(), Cache->GetPrefetches(),
+            ModSet->GetWrites(), ModSet->GetWrittenSectors());
+
+    printf("I/O queue: %d entries, stale entries: %d\r\n", GetQueueSize(), GetStaleCount());
 }
 
 /*##########################################################################
@@ -432,22 +1269,87 @@ bool TFat::IsFree(unsigned int Cluster)
 ##########################################################################*/
 unsigned int TFat::AllocateCluster()
 {
-    unsigned int Cluster;
+    unsigned int Cluster = 0;
     unsigned int Link;
 
+    FSection.Enter();
+
+    BeginModify();
+
     while (!FStopped)
     {
         Cluster = FatTable1->AllocateCluster();
 
-        if (!Cluster)
-            return 0;
+        if (!Cluster || FMirror)
+            break;
 
         if (FatTable2->ReserveCluster(Cluster))
-            return Cluster;
+            break;
         else
         {
             Link = FatTable2->GetClusterLink(Cluster);
             FatTable1->LinkCluster(Cluster, Link);
+            Cluster = 0;
+        }
+    }
+
+    FSection.Leave();
+
+    return Cluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TFat::AllocateRun
+#
+#   Purpose....: Allocate a run of contiguous clusters in both FATs.
+#                If the second FAT has a conflicting entry, the run is
+#                cut at that cluster and the rest is returned to the
+#                first FAT. In mirror mode only the first FAT is used.
+#
+#   In params..: Count          Wanted clusters
+#   Out params.: Size           Allocated clusters
+#   Returns....: First cluster, or 0 if none could be allocated
+#
+##########################################################################*/
+unsigned int TFat::AllocateRun(unsigned int Count, unsigned int *Size)
+{
+    unsigned int Cluster;
+    unsigned int Link;
+    unsigned int Len;
+    unsigned int i;
+
+    *Size = 0;
+
+    while (!FStopped)
+    {
+        Cluster = FatTable1->AllocateRun(Count, &Len);
+
+        if (!Cluster)
+            return 0;
+
+        if (FMirror)
+        {
+            *Size = Len;
+            return Cluster;
+        }
+
+        for (i = 0; i < Len; i++)
+            if (!FatTable2->ReserveCluster(Cluster + i))
+                break;
+
+        if (i < Len)
+        {
+            Link = FatTable2->GetClusterLink(Cluster + i);
+            FatTable1->LinkCluster(Cluster + i, Link);
+
+            FatTable1->FreeRun(Cluster + i + 1, Len - i - 1);
+        }
+
+        if (i)
+        {
+            *Size = i;
+            return Cluster;
         }
     }
     return 0;
@@ -457,7 +1359,8 @@ unsigned int TFat::AllocateCluster()
 #
 #   Name       : TFat::Complete
 #
-#   Purpose....: Complete FAT table modification
+#   Purpose....: Complete FAT table modification. Writes all dirty
+#                FAT sectors in sector order, and then free cluster info
 #
 #   In params..: *
 #   Out params.: *
@@ -466,8 +1369,18 @@ unsigned int TFat::AllocateCluster()
 ##########################################################################*/
 void TFat::Complete()
 {
+    FSection.Enter();
+
     FatTable1->Complete();
     FatTable2->Complete();
+
+    if (FModified)
+    {
+        FModified = false;
+        UpdateInfo(true);
+    }
+
+    FSection.Leave();
 }
 
 /*##########################################################################
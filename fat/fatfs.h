@@ -34,9 +34,20 @@
 
 #include "fs.h"
 #include "tab.h"
+#include "fatscan.h"
 #include "cluster.h"
 #include "fatdir.h"
 
+#define FAT_LAZY_CLUSTERS   4096
+#define FAT_ALLOC_CURSORS   8
+
+class TFatFile;
+
+struct TFatAllocGroup
+{
+    TCluster *Chain;
+    unsigned int Group;
+};
 
 struct TBaseBootSector
 {
@@ -93,13 +104,20 @@ public:
     TFat(TPartServer *server, struct TBaseBootSector *boot);
     ~TFat();
 
+    virtual void Stop();
+    virtual void Run();
+
     bool Validate();
+    void LogCacheStats();
+    void ExecuteFlush();
+    void ExecuteScan();
     virtual int Format(long long *Start, long long *Count);
     virtual long long GetFreeSectors();
     virtual TDir *CacheDir(TDir *ParentDir, int ParentIndex, long long Inode);
     virtual TFile *OpenFile(TDir *ParentDir, int ParentIndex, long long Inode);
     virtual bool CreateDir(TDir *ParentDir, const char *Name);
     virtual bool CreateFile(TDir *ParentDir, const char *Name, int Attrib);
+    virtual bool Idle(int Worker);
 
     int FatSize;
     unsigned int PartSectors;
@@ -122,16 +140,55 @@ protected:
 
     bool IsFree(unsigned int Cluster);
     unsigned int AllocateCluster();
+    unsigned int AllocateRun(unsigned int Count, unsigned int *Size);
     void Complete();
 
-    bool GrowClusterChain(TCluster *Chain, unsigned int Count);
+    bool GrowClusterChain(TCluster *Chain, unsigned int Count, unsigned int Hint);
     bool ShrinkClusterChain(TCluster *Chain, unsigned int Count);
+    void ReleaseChain(TCluster *Chain);
+
+    unsigned int PlaceChain(TCluster *Chain, unsigned int Hint);
+    bool IsActiveGroup(TCluster *Chain, unsigned int Group);
+    void SetActiveGroup(TCluster *Chain);
+
+    void SetupScan();
+    void CompleteScan(int Depth);
+    bool GetScannedFree(unsigned int *Free);
+
+    void BeginModify();
+    virtual void UpdateInfo(bool Valid);
 
     TCluster *GetClusterChain(unsigned int Cluster);
+    bool ExtendClusterChain(TCluster *Chain, unsigned int *Next, unsigned int Count);
     bool SetClusterCount(TCluster *Chain, unsigned int Clusters);
 
     TFatTable *FatTable1;
     TFatTable *FatTable2;
+
+    TSection FSection;
+    bool FFlushActive;
+    bool FMirror;
+
+    TFatScan *FScan;
+    bool FScanTables;
+    bool FScanPending;
+    bool FScanActive;
+
+    bool FModified;
+    bool FClean;
+
+    void AddLazy(TFatFile *File);
+    void RemoveLazy(TFatFile *File);
+
+    TSection FLazySection;
+    TFatFile **FLazyArr;
+    int FLazyCount;
+    int FLazySize;
+    int FLazyNext;
+    TFatFile *FLazyBusy[FS_MAX_WORKERS];
+
+    struct TFatAllocGroup FAllocArr[FAT_ALLOC_CURSORS];
+    int FAllocNext;
 };
 
 #endif
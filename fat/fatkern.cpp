@@ -0,0 +1,1111 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# fatkern.cpp
+# FAT entry kernels
+#
+########################################################################*/
+
+#include <stdio.h>
+#include "fatkern.h"
+
+#define FAT_BENCH_ENTRIES   0x10000
+#define FAT_BENCH_ROUNDS    16
+
+typedef void (*TFatMask16Proc)(const unsigned short int *Tab, unsigned int *Mask, unsigned int Words);
+typedef void (*TFatMask32Proc)(const unsigned int *Tab, unsigned int *Mask, unsigned int Words);
+typedef void (*TFatLink16Proc)(unsigned short int *Tab, const unsigned short int *Base, unsigned int Blocks);
+typedef void (*TFatLink32Proc)(unsigned int *Tab, const unsigned int *Base, unsigned int Blocks);
+
+int KernFirstBit(unsigned int val);
+#pragma aux KernFirstBit = \
+    "bsf eax,eax" \
+    __parm [__eax] \
+    __value [__eax]
+
+int HasCpuId();
+#pragma aux HasCpuId = \
+    "pushfd" \
+    "pop eax" \
+    "mov edx,eax" \
+    "xor eax,200000h" \
+    "push eax" \
+    "popfd" \
+    "pushfd" \
+    "pop eax" \
+    "xor eax,edx" \
+    "and eax,200000h" \
+    __value [__eax] \
+    __modify [__edx]
+
+unsigned int CpuIdMax();
+#pragma aux CpuIdMax = \
+    "xor eax,eax" \
+    "cpuid" \
+    __value [__eax] \
+    __modify [__ebx __ecx __edx]
+
+unsigned int CpuIdEcx(unsigned int Leaf);
+#pragma aux CpuIdEcx = \
+    "xor ecx,ecx" \
+    "cpuid" \
+    __parm [__eax] \
+    __value [__ecx] \
+    __modify [__eax __ebx __edx]
+
+unsigned int CpuIdEdx(unsigned int Leaf);
+#pragma aux CpuIdEdx = \
+    "xor ecx,ecx" \
+    "cpuid" \
+    __parm [__eax] \
+    __value [__edx] \
+    __modify [__eax __ebx __ecx]
+
+unsigned int CpuIdEbx(unsigned int Leaf);
+#pragma aux CpuIdEbx = \
+    "xor ecx,ecx" \
+    "cpuid" \
+    __parm [__eax] \
+    __value [__ebx] \
+    __modify [__eax __ecx __edx]
+
+unsigned int GetXcr0();
+#pragma aux GetXcr0 = \
+    "xor ecx,ecx" \
+    0x0F 0x01 0xD0 \
+    __value [__eax] \
+    __modify [__ecx __edx]
+
+long long ReadTsc();
+#pragma aux ReadTsc = \
+    "rdtsc" \
+    __value [__edx __eax]
+
+void Mask16Sse2Asm(const unsigned short int *Tab, unsigned int *Mask, unsigned int Words);
+#pragma aux Mask16Sse2Asm = \
+    "pxor xmm6,xmm6" \
+    "m16s_loop: movdqu xmm0,[esi]" \
+    "movdqu xmm1,[esi+16]" \
+    "movdqu xmm2,[esi+32]" \
+    "movdqu xmm3,[esi+48]" \
+    "pcmpeqw xmm0,xmm6" \
+    "pcmpeqw xmm1,xmm6" \
+    "pcmpeqw xmm2,xmm6" \
+    "pcmpeqw xmm3,xmm6" \
+    "packsswb xmm0,xmm1" \
+    "packsswb xmm2,xmm3" \
+    "pmovmskb eax,xmm0" \
+    "pmovmskb edx,xmm2" \
+    "shl edx,16" \
+    "or eax,edx" \
+    "mov [edi],eax" \
+    "add esi,64" \
+    "add edi,4" \
+    "dec ecx" \
+    "jnz m16s_loop" \
+    __parm [__esi] [__edi] [__ecx] \
+    __modify [__eax __ecx __edx __esi __edi]
+
+void Mask32Sse2Asm(const unsigned int *Tab, unsigned int *Mask, unsigned int Words);
+#pragma aux Mask32Sse2Asm = \
+    "pcmpeqd xmm7,xmm7" \
+    "psrld xmm7,4" \
+    "pxor xmm6,xmm6" \
+    "m32s_loop: movdqu xmm0,[esi]" \
+    "movdqu xmm1,[esi+16]" \
+    "movdqu xmm2,[esi+32]" \
+    "movdqu xmm3,[esi+48]" \
+    "pand xmm0,xmm7" \
+    "pand xmm1,xmm7" \
+    "pand xmm2,xmm7" \
+    "pand xmm3,xmm7" \
+    "pcmpeqd xmm0,xmm6" \
+    "pcmpeqd xmm1,xmm6" \
+    "pcmpeqd xmm2,xmm6" \
+    "pcmpeqd xmm3,xmm6" \
+    "packssdw xmm0,xmm1" \
+    "packssdw xmm2,xmm3" \
+    "packsswb xmm0,xmm2" \
+    "pmovmskb eax,xmm0" \
+    "movdqu xmm0,[esi+64]" \
+    "movdqu xmm1,[esi+80]" \
+    "movdqu xmm2,[esi+96]" \
+    "movdqu xmm3,[esi+112]" \
+    "pand xmm0,xmm7" \
+    "pand xmm1,xmm7" \
+    "pand xmm2,xmm7" \
+    "pand xmm3,xmm7" \
+    "pcmpeqd xmm0,xmm6" \
+    "pcmpeqd xmm1,xmm6" \
+    "pcmpeqd xmm2,xmm6" \
+    "pcmpeqd xmm3,xmm6" \
+    "packssdw xmm0,xmm1" \
+    "packssdw xmm2,xmm3" \
+    "packsswb xmm0,xmm2" \
+    "pmovmskb edx,xmm0" \
+    "shl edx,16" \
+    "or eax,edx" \
+    "mov [edi],eax" \
+    "add esi,128" \
+    "add edi,4" \
+    "dec ecx" \
+    "jnz m32s_loop" \
+    __parm [__esi] [__edi] [__ecx] \
+    __modify [__eax __ecx __edx __esi __edi]
+
+void Mask16Avx2Asm(const unsigned short int *Tab, unsigned int *Mask, unsigned int Words);
+#pragma aux Mask16Avx2Asm = \
+    "vpxor ymm6,ymm6,ymm6" \
+    "m16a_loop: vpcmpeqw ymm0,ymm6,[esi]" \
+    "vpcmpeqw ymm1,ymm6,[esi+32]" \
+    "vpacksswb ymm0,ymm0,ymm1" \
+    "vpermq ymm0,ymm0,0D8h" \
+    "vpmovmskb eax,ymm0" \
+    "mov [edi],eax" \
+    "add esi,64" \
+    "add edi,4" \
+    "dec ecx" \
+    "jnz m16a_loop" \
+    "vzeroupper" \
+    __parm [__esi] [__edi] [__ecx] \
+    __modify [__eax __ecx __esi __edi]
+
+void Mask32Avx2Asm(const unsigned int *Tab, unsigned int *Mask, unsigned int Words);
+#pragma aux Mask32Avx2Asm = \
+    "vpcmpeqd ymm7,ymm7,ymm7" \
+    "vpsrld ymm7,ymm7,4" \
+    "vpxor ymm6,ymm6,ymm6" \
+    "m32a_loop: vpand ymm0,ymm7,[esi]" \
+    "vpand ymm1,ymm7,[esi+32]" \
+    "vpand ymm2,ymm7,[esi+64]" \
+    "vpand ymm3,ymm7,[esi+96]" \
+    "vpcmpeqd ymm0,ymm0,ymm6" \
+    "vpcmpeqd ymm1,ymm1,ymm6" \
+    "vpcmpeqd ymm2,ymm2,ymm6" \
+    "vpcmpeqd ymm3,ymm3,ymm6" \
+    "vpackssdw ymm0,ymm0,ymm1" \
+    "vpackssdw ymm2,ymm2,ymm3" \
+    "vpacksswb ymm0,ymm0,ymm2" \
+    "vpermq ymm0,ymm0,0D8h" \
+    "vpshufd ymm0,ymm0,0D8h" \
+    "vpmovmskb eax,ymm0" \
+    "mov [edi],eax" \
+    "add esi,128" \
+    "add edi,4" \
+    "dec ecx" \
+    "jnz m32a_loop" \
+    "vzeroupper" \
+    __parm [__esi] [__edi] [__ecx] \
+    __modify [__eax __ecx __esi __edi]
+
+void Link16Sse2Asm(unsigned short int *Tab, const unsigned short int *Base, unsigned int Blocks);
+#pragma aux Link16Sse2Asm = \
+    "movdqu xmm4,[edx]" \
+    "mov eax,8" \
+    "movd xmm5,eax" \
+    "pshuflw xmm5,xmm5,0" \
+    "pshufd xmm5,xmm5,0" \
+    "l16s_loop: movdqu [edi],xmm4" \
+    "paddw xmm4,xmm5" \
+    "movdqu [edi+16],xmm4" \
+    "paddw xmm4,xmm5" \
+    "add edi,32" \
+    "dec ecx" \
+    "jnz l16s_loop" \
+    __parm [__edi] [__edx] [__ecx] \
+    __modify [__eax __ecx __edi]
+
+void Link32Sse2Asm(unsigned int *Tab, const unsigned int *Base, unsigned int Blocks);
+#pragma aux Link32Sse2Asm = \
+    "movdqu xmm4,[edx]" \
+    "pcmpeqd xmm7,xmm7" \
+    "pslld xmm7,28" \
+    "mov eax,4" \
+    "movd xmm5,eax" \
+    "pshufd xmm5,xmm5,0" \
+    "l32s_loop: movdqu xmm0,[edi]" \
+    "movdqu xmm1,[edi+16]" \
+    "pand xmm0,xmm7" \
+    "pand xmm1,xmm7" \
+    "por xmm0,xmm4" \
+    "paddd xmm4,xmm5" \
+    "por xmm1,xmm4" \
+    "paddd xmm4,xmm5" \
+    "movdqu [edi],xmm0" \
+    "movdqu [edi+16],xmm1" \
+    "add edi,32" \
+    "dec ecx" \
+    "jnz l32s_loop" \
+    __parm [__edi] [__edx] [__ecx] \
+    __modify [__eax __ecx __edi]
+
+static int MaxLevel = FAT_KERNEL_C;
+static int CurrLevel = FAT_KERNEL_C;
+static TFatMask16Proc Mask16Proc = 0;
+static TFatMask32Proc Mask32Proc = 0;
+static TFatLink16Proc Link16Proc = 0;
+static TFatLink32Proc Link32Proc = 0;
+
+/*##########################################################################
+#
+#   Name       : Mask16C
+#
+#   Purpose....: Build free masks for 16-bit entries, 32 entries per word
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Mask16C(const unsigned short int *Tab, unsigned int *Mask, unsigned int Words)
+{
+    unsigned int i;
+    unsigned int m;
+
+    while (Words)
+    {
+        m = 0;
+
+        for (i = 0; i < 32; i++)
+            if (Tab[i] == 0)
+                m |= 1 << i;
+
+        *Mask = m;
+        Mask++;
+        Tab += 32;
+        Words--;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : Mask32C
+#
+#   Purpose....: Build free masks for 32-bit entries, 32 entries per word
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Mask32C(const unsigned int *Tab, unsigned int *Mask, unsigned int Words)
+{
+    unsigned int i;
+    unsigned int m;
+
+    while (Words)
+    {
+        m = 0;
+
+        for (i = 0; i < 32; i++)
+            if ((Tab[i] & 0x0FFFFFFF) == 0)
+                m |= 1 << i;
+
+        *Mask = m;
+        Mask++;
+        Tab += 32;
+        Words--;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : Mask16Sse2
+#
+#   Purpose....: Build free masks for 16-bit entries with SSE2
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Mask16Sse2(const unsigned short int *Tab, unsigned int *Mask, unsigned int Words)
+{
+    Mask16Sse2Asm(Tab, Mask, Words);
+}
+
+/*##########################################################################
+#
+#   Name       : Mask32Sse2
+#
+#   Purpose....: Build free masks for 32-bit entries with SSE2
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Mask32Sse2(const unsigned int *Tab, unsigned int *Mask, unsigned int Words)
+{
+    Mask32Sse2Asm(Tab, Mask, Words);
+}
+
+/*##########################################################################
+#
+#   Name       : Mask16Avx2
+#
+#   Purpose....: Build free masks for 16-bit entries with AVX2
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Mask16Avx2(const unsigned short int *Tab, unsigned int *Mask, unsigned int Words)
+{
+    Mask16Avx2Asm(Tab, Mask, Words);
+}
+
+/*##########################################################################
+#
+#   Name       : Mask32Avx2
+#
+#   Purpose....: Build free masks for 32-bit entries with AVX2
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Mask32Avx2(const unsigned int *Tab, unsigned int *Mask, unsigned int Words)
+{
+    Mask32Avx2Asm(Tab, Mask, Words);
+}
+
+/*##########################################################################
+#
+#   Name       : Link16C
+#
+#   Purpose....: Write increasing 16-bit links, 16 entries per block
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Link16C(unsigned short int *Tab, const unsigned short int *Base, unsigned int Blocks)
+{
+    unsigned int i;
+    unsigned short int Link = Base[0];
+
+    while (Blocks)
+    {
+        for (i = 0; i < 16; i++)
+        {
+            Tab[i] = Link;
+            Link++;
+        }
+
+        Tab += 16;
+        Blocks--;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : Link32C
+#
+#   Purpose....: Write increasing 32-bit links, 8 entries per block.
+#                The reserved top 4 bits are kept
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Link32C(unsigned int *Tab, const unsigned int *Base, unsigned int Blocks)
+{
+    unsigned int i;
+    unsigned int Link = Base[0];
+
+    while (Blocks)
+    {
+        for (i = 0; i < 8; i++)
+        {
+            Tab[i] = (Tab[i] & 0xF0000000) | Link;
+            Link++;
+        }
+
+        Tab += 8;
+        Blocks--;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : Link16Sse2
+#
+#   Purpose....: Write increasing 16-bit links with SSE2
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Link16Sse2(unsigned short int *Tab, const unsigned short int *Base, unsigned int Blocks)
+{
+    Link16Sse2Asm(Tab, Base, Blocks);
+}
+
+/*##########################################################################
+#
+#   Name       : Link32Sse2
+#
+#   Purpose....: Write increasing 32-bit links with SSE2
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void Link32Sse2(unsigned int *Tab, const unsigned int *Base, unsigned int Blocks)
+{
+    Link32Sse2Asm(Tab, Base, Blocks);
+}
+
+/*##########################################################################
+#
+#   Name       : DetectLevel
+#
+#   Purpose....: Find best kernel level the processor and OS supports.
+#                AVX2 also needs the OS to save YMM state (XCR0)
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static int DetectLevel()
+{
+    unsigned int Max;
+    int Level = FAT_KERNEL_C;
+
+    if (!HasCpuId())
+        return Level;
+
+    Max = CpuIdMax();
+    if (Max < 1)
+        return Level;
+
+    if (CpuIdEdx(1) & 0x4000000)
+        Level = FAT_KERNEL_SSE2;
+    else
+        return Level;
+
+    if (Max >= 7)
+        if (CpuIdEcx(1) & 0x8000000)
+            if ((GetXcr0() & 6) == 6)
+                if (CpuIdEbx(7) & 0x20)
+                    Level = FAT_KERNEL_AVX2;
+
+    return Level;
+}
+
+/*##########################################################################
+#
+#   Name       : FatKernelSetup
+#
+#   Purpose....: Select kernels. A level above what the processor
+#                supports is lowered
+#
+#   In params..: Level          Wanted level, or FAT_KERNEL_AUTO for best
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void FatKernelSetup(int Level)
+{
+    MaxLevel = DetectLevel();
+
+    if (Level == FAT_KERNEL_AUTO || Level > MaxLevel)
+        Level = MaxLevel;
+
+    switch (Level)
+    {
+        case FAT_KERNEL_AVX2:
+            Mask16Proc = Mask16Avx2;
+            Mask32Proc = Mask32Avx2;
+            Link16Proc = Link16Sse2;
+            Link32Proc = Link32Sse2;
+            break;
+
+        case FAT_KERNEL_SSE2:
+            Mask16Proc = Mask16Sse2;
+            Mask32Proc = Mask32Sse2;
+            Link16Proc = Link16Sse2;
+            Link32Proc = Link32Sse2;
+            break;
+
+        default:
+            Level = FAT_KERNEL_C;
+            Mask16Proc = Mask16C;
+            Mask32Proc = Mask32C;
+            Link16Proc = Link16C;
+            Link32Proc = Link32C;
+            break;
+    }
+
+    CurrLevel = Level;
+}
+
+/*##########################################################################
+#
+#   Name       : FatKernelLevel
+#
+#   Purpose....: Get selected kernel level
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int FatKernelLevel()
+{
+    return CurrLevel;
+}
+
+/*##########################################################################
+#
+#   Name       : FatKernelMaxLevel
+#
+#   Purpose....: Get best kernel level the processor supports
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int FatKernelMaxLevel()
+{
+    return MaxLevel;
+}
+
+/*##########################################################################
+#
+#   Name       : FatKernelName
+#
+#   Purpose....: Get name of kernel level
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+const char *FatKernelName(int Level)
+{
+    switch (Level)
+    {
+        case FAT_KERNEL_AVX2:
+            return "avx2";
+
+        case FAT_KERNEL_SSE2:
+            return "sse2";
+
+        default:
+            return "c";
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : FatBitCount
+#
+#   Purpose....: Count set bits
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int FatBitCount(unsigned int Val)
+{
+    Val = Val - ((Val >> 1) & 0x55555555);
+    Val = (Val & 0x33333333) + ((Val >> 2) & 0x33333333);
+    Val = (Val + (Val >> 4)) & 0x0F0F0F0F;
+    return (int)((Val * 0x01010101) >> 24);
+}
+
+/*##########################################################################
+#
+#   Name       : FatFreeMask16
+#
+#   Purpose....: Build free masks for 16-bit entries. Bit n of the mask
+#                is set if entry n is free. Bits past the last entry
+#                are cleared
+#
+#   In params..: Tab            Entries
+#                Entries        Number of entries
+#   Out params.: Mask           (Entries + 31) / 32 words
+#   Returns....: Number of free entries
+#
+##########################################################################*/
+unsigned int FatFreeMask16(const unsigned short int *Tab, unsigned int *Mask, unsigned int Entries)
+{
+    unsigned int Words = Entries >> 5;
+    unsigned int Rest = Entries & 0x1F;
+    unsigned int Count = 0;
+    unsigned int i;
+    unsigned int m;
+
+    if (!Mask16Proc)
+        FatKernelSetup(FAT_KERNEL_AUTO);
+
+    if (Words)
+        (*Mask16Proc)(Tab, Mask, Words);
+
+    if (Rest)
+    {
+        Tab += Words << 5;
+        m = 0;
+
+        for (i = 0; i < Rest; i++)
+            if (Tab[i] == 0)
+                m |= 1 << i;
+
+        Mask[Words] = m;
+        Words++;
+    }
+
+    for (i = 0; i < Words; i++)
+        if (Mask[i])
+            Count += FatBitCount(Mask[i]);
+
+    return Count;
+}
+
+/*##########################################################################
+#
+#   Name       : FatFreeMask32
+#
+#   Purpose....: Build free masks for 32-bit entries. Only the low
+#                28 bits of an entry are checked
+#
+#   In params..: Tab            Entries
+#                Entries        Number of entries
+#   Out params.: Mask           (Entries + 31) / 32 words
+#   Returns....: Number of free entries
+#
+##########################################################################*/
+unsigned int FatFreeMask32(const unsigned int *Tab, unsigned int *Mask, unsigned int Entries)
+{
+    unsigned int Words = Entries >> 5;
+    unsigned int Rest = Entries & 0x1F;
+    unsigned int Count = 0;
+    unsigned int i;
+    unsigned int m;
+
+    if (!Mask32Proc)
+        FatKernelSetup(FAT_KERNEL_AUTO);
+
+    if (Words)
+        (*Mask32Proc)(Tab, Mask, Words);
+
+    if (Rest)
+    {
+        Tab += Words << 5;
+        m = 0;
+
+        for (i = 0; i < Rest; i++)
+            if ((Tab[i] & 0x0FFFFFFF) == 0)
+                m |= 1 << i;
+
+        Mask[Words] = m;
+        Words++;
+    }
+
+    for (i = 0; i < Words; i++)
+        if (Mask[i])
+            Count += FatBitCount(Mask[i]);
+
+    return Count;
+}
+
+/*##########################################################################
+#
+#   Name       : FatFindFree16
+#
+#   Purpose....: Find first free 16-bit entry
+#
+#   In params..: Tab            Entries
+#                Entries        Number of entries
+#   Out params.: *
+#   Returns....: Index of entry, or -1 if none is free
+#
+##########################################################################*/
+int FatFindFree16(const unsigned short int *Tab, unsigned int Entries)
+{
+    unsigned int i;
+    unsigned int m;
+
+    for (i = 0; i < Entries; i += 32)
+    {
+        if (Entries - i >= 32)
+        {
+            if (!Mask16Proc)
+                FatKernelSetup(FAT_KERNEL_AUTO);
+
+            (*Mask16Proc)(Tab + i, &m, 1);
+        }
+        else
+            FatFreeMask16(Tab + i, &m, Entries - i);
+
+        if (m)
+            return (int)i + KernFirstBit(m);
+    }
+
+    return -1;
+}
+
+/*##########################################################################
+#
+#   Name       : FatFindFree32
+#
+#   Purpose....: Find first free 32-bit entry
+#
+#   In params..: Tab            Entries
+#                Entries        Number of entries
+#   Out params.: *
+#   Returns....: Index of entry, or -1 if none is free
+#
+##########################################################################*/
+int FatFindFree32(const unsigned int *Tab, unsigned int Entries)
+{
+    unsigned int i;
+    unsigned int m;
+
+    for (i = 0; i < Entries; i += 32)
+    {
+        if (Entries - i >= 32)
+        {
+            if (!Mask32Proc)
+                FatKernelSetup(FAT_KERNEL_AUTO);
+
+            (*Mask32Proc)(Tab + i, &m, 1);
+        }
+        else
+            FatFreeMask32(Tab + i, &m, Entries - i);
+
+        if (m)
+            return (int)i + KernFirstBit(m);
+    }
+
+    return -1;
+}
+
+/*##########################################################################
+#
+#   Name       : FatFindRun
+#
+#   Purpose....: Find longest run of set bits in free masks. Words that
+#                are all free or all used are handled as a whole
+#
+#   In params..: Mask           Free masks
+#                Bits           Number of bits
+#   Out params.: Start          First bit of run
+#   Returns....: Length of run, 0 if no bit is set
+#
+##########################################################################*/
+unsigned int FatFindRun(const unsigned int *Mask, unsigned int Bits, unsigned int *Start)
+{
+    unsigned int i = 0;
+    unsigned int m;
+    unsigned int Pos = 0;
+    unsigned int Len = 0;
+    unsigned int Best = 0;
+
+    *Start = 0;
+
+    while (i < Bits)
+    {
+        m = Mask[i >> 5];
+
+        if ((i & 0x1F) == 0 && Bits - i >= 32)
+        {
+            if (m == 0)
+            {
+                if (Len > Best)
+                {
+                    Best = Len;
+                    *Start = Pos;
+                }
+                Len = 0;
+                i += 32;
+                continue;
+            }
+
+            if (m == 0xFFFFFFFF)
+            {
+                if (!Len)
+                    Pos = i;
+                Len += 32;
+                i += 32;
+                continue;
+            }
+        }
+
+        if (m & (1 << (i & 0x1F)))
+        {
+            if (!Len)
+                Pos = i;
+            Len++;
+        }
+        else
+        {
+            if (Len > Best)
+            {
+                Best = Len;
+                *Start = Pos;
+            }
+            Len = 0;
+        }
+        i++;
+    }
+
+    if (Len > Best)
+    {
+        Best = Len;
+        *Start = Pos;
+    }
+
+    return Best;
+}
+
+/*##########################################################################
+#
+#   Name       : FatUnpack12
+#
+#   Purpose....: Unpack 12-bit entries. Eight entries are decoded from
+#                three 32-bit loads, and the rest from 3-byte pairs
+#
+#   In params..: Data           Packed table, starting at an even entry
+#                Entries        Number of entries
+#   Out params.: Tab            Unpacked entries
+#   Returns....: *
+#
+##########################################################################*/
+void FatUnpack12(const char *Data, unsigned short int *Tab, unsigned int Entries)
+{
+    const unsigned int *Ptr;
+    const unsigned char *Byte;
+    unsigned int w0;
+    unsigned int w1;
+    unsigned int w2;
+
+    while (Entries >= 8)
+    {
+        Ptr = (const unsigned int *)Data;
+        w0 = Ptr[0];
+        w1 = Ptr[1];
+        w2 = Ptr[2];
+
+        Tab[0] = (unsigned short int)(w0 & 0xFFF);
+        Tab[1] = (unsigned short int)((w0 >> 12) & 0xFFF);
+        Tab[2] = (unsigned short int)(((w0 >> 24) | (w1 << 8)) & 0xFFF);
+        Tab[3] = (unsigned short int)((w1 >> 4) & 0xFFF);
+        Tab[4] = (unsigned short int)((w1 >> 16) & 0xFFF);
+        Tab[5] = (unsigned short int)(((w1 >> 28) | (w2 << 4)) & 0xFFF);
+        Tab[6] = (unsigned short int)((w2 >> 8) & 0xFFF);
+        Tab[7] = (unsigned short int)(w2 >> 20);
+
+        Data += 12;
+        Tab += 8;
+        Entries -= 8;
+    }
+
+    Byte = (const unsigned char *)Data;
+
+    while (Entries)
+    {
+        Tab[0] = (unsigned short int)(Byte[0] | ((Byte[1] & 0xF) << 8));
+        Entries--;
+
+        if (Entries)
+        {
+            Tab[1] = (unsigned short int)((Byte[1] >> 4) | (Byte[2] << 4));
+            Entries--;
+        }
+
+        Byte += 3;
+        Tab += 2;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : FatLinkRun16
+#
+#   Purpose....: Link consecutive 16-bit entries. Entry i is set to
+#                Link + i
+#
+#   In params..: Tab            Entries
+#                Link           Link of first entry
+#                Entries        Number of entries
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void FatLinkRun16(unsigned short int *Tab, unsigned int Link, unsigned int Entries)
+{
+    unsigned short int Base[8];
+    unsigned int Blocks = Entries >> 4;
+    unsigned int i;
+
+    if (!Link16Proc)
+        FatKernelSetup(FAT_KERNEL_AUTO);
+
+    if (Blocks)
+    {
+        for (i = 0; i < 8; i++)
+            Base[i] = (unsigned short int)(Link + i);
+
+        (*Link16Proc)(Tab, Base, Blocks);
+
+        Tab += Blocks << 4;
+        Link += Blocks << 4;
+    }
+
+    for (i = 0; i < (Entries & 0xF); i++)
+        Tab[i] = (unsigned short int)(Link + i);
+}
+
+/*##########################################################################
+#
+#   Name       : FatLinkRun32
+#
+#   Purpose....: Link consecutive 32-bit entries. Entry i is set to
+#                Link + i, and the reserved top 4 bits are kept
+#
+#   In params..: Tab            Entries
+#                Link           Link of first entry
+#                Entries        Number of entries
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void FatLinkRun32(unsigned int *Tab, unsigned int Link, unsigned int Entries)
+{
+    unsigned int Base[4];
+    unsigned int Blocks = Entries >> 3;
+    unsigned int i;
+
+    if (!Link32Proc)
+        FatKernelSetup(FAT_KERNEL_AUTO);
+
+    if (Blocks)
+    {
+        for (i = 0; i < 4; i++)
+            Base[i] = Link + i;
+
+        (*Link32Proc)(Tab, Base, Blocks);
+
+        Tab += Blocks << 3;
+        Link += Blocks << 3;
+    }
+
+    for (i = 0; i < (Entries & 0x7); i++)
+        Tab[i] = (Tab[i] & 0xF0000000) | (Link + i);
+}
+
+/*##########################################################################
+#
+#   Name       : BenchLevel
+#
+#   Purpose....: Measure free mask kernels at one level
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void BenchLevel(int Level, unsigned int *Tab32, unsigned short int *Tab16, unsigned int *Mask)
+{
+    int i;
+    long long Start;
+    long long Cycles16;
+    long long Cycles32;
+    long long Entries = (long long)FAT_BENCH_ENTRIES * FAT_BENCH_ROUNDS;
+
+    FatKernelSetup(Level);
+
+    Start = ReadTsc();
+    for (i = 0; i < FAT_BENCH_ROUNDS; i++)
+        FatFreeMask16(Tab16, Mask, FAT_BENCH_ENTRIES);
+    Cycles16 = ReadTsc() - Start;
+
+    Start = ReadTsc();
+    for (i = 0; i < FAT_BENCH_ROUNDS; i++)
+        FatFreeMask32(Tab32, Mask, FAT_BENCH_ENTRIES);
+    Cycles32 = ReadTsc() - Start;
+
+    printf("FAT kernel %s: FAT16 %d.%02d, FAT32 %d.%02d cycles/entry\r\n",
+            FatKernelName(Level),
+            (int)(Cycles16 / Entries), (int)(Cycles16 * 100 / Entries % 100),
+            (int)(Cycles32 / Entries), (int)(Cycles32 * 100 / Entries % 100));
+}
+
+/*##########################################################################
+#
+#   Name       : FatKernelBench
+#
+#   Purpose....: Measure cycles per entry for every supported kernel
+#                level, and restore the selected level
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void FatKernelBench()
+{
+    unsigned int *Tab32 = new unsigned int[FAT_BENCH_ENTRIES];
+    unsigned short int *Tab16 = new unsigned short int[FAT_BENCH_ENTRIES];
+    unsigned int *Mask = new unsigned int[FAT_BENCH_ENTRIES / 32];
+    int Level = FatKernelLevel();
+    int i;
+
+    for (i = 0; i < FAT_BENCH_ENTRIES; i++)
+    {
+        if (i % 7 == 0 || i % 13 == 0)
+        {
+            Tab32[i] = 0;
+            Tab16[i] = 0;
+        }
+        else
+        {
+            Tab32[i] = i + 1;
+            Tab16[i] = (unsigned short int)(i | 1);
+        }
+    }
+
+    for (i = FAT_KERNEL_C; i <= FatKernelMaxLevel(); i++)
+        BenchLevel(i, Tab32, Tab16, Mask);
+
+    FatKernelSetup(Level);
+
+    delete Mask;
+    delete Tab16;
+    delete Tab32;
+}
@@ -0,0 +1,64 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# fatkern.h
+# FAT entry kernels
+#
+########################################################################*/
+
+#ifndef _FAT_KERN_H
+#define _FAT_KERN_H
+
+#define FAT_KERNEL_AUTO     -1
+#define FAT_KERNEL_C        0
+#define FAT_KERNEL_SSE2     1
+#define FAT_KERNEL_AVX2     2
+
+#define FAT_KERNEL_CHUNK    512
+
+void FatKernelSetup(int Level);
+int FatKernelLevel();
+int FatKernelMaxLevel();
+const char *FatKernelName(int Level);
+
+int FatBitCount(unsigned int Val);
+
+unsigned int FatFreeMask16(const unsigned short int *Tab, unsigned int *Mask, unsigned int Entries);
+unsigned int FatFreeMask32(const unsigned int *Tab, unsigned int *Mask, unsigned int Entries);
+
+int FatFindFree16(const unsigned short int *Tab, unsigned int Entries);
+int FatFindFree32(const unsigned int *Tab, unsigned int Entries);
+
+unsigned int FatFindRun(const unsigned int *Mask, unsigned int Bits, unsigned int *Start);
+
+void FatUnpack12(const char *Data, unsigned short int *Tab, unsigned int Entries);
+
+void FatLinkRun16(unsigned short int *Tab, unsigned int Link, unsigned int Entries);
+void FatLinkRun32(unsigned int *Tab, unsigned int Link, unsigned int Entries);
+
+void FatKernelBench();
+
+#endif
@@ -0,0 +1,378 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# fatscan.cpp
+# Pipelined FAT table scan
+#
+########################################################################*/
+
+#include <memory.h>
+#include "fatscan.h"
+
+/*##########################################################################
+#
+#   Name       : TFatScan::TFatScan
+#
+#   Purpose....: FAT scan constructor. Creates one req for each block
+#                in flight. Fewer are used if the partition runs out of
+#                reqs
+#
+#   In params..: Server         Partition server
+#                Depth          Blocks in flight, at most FAT_SCAN_DEPTH
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatScan::TFatScan(TPartServer *Server, int Depth)
+{
+    int i;
+
+    if (Depth < 1)
+        Depth = 1;
+
+    if (Depth > FAT_SCAN_DEPTH)
+        Depth = FAT_SCAN_DEPTH;
+
+    FDepth = 0;
+
+    for (i = 0; i < Depth; i++)
+    {
+        FSlotArr[i].Req = new TPartReq(Server, false);
+
+        if (!FSlotArr[i].Req->IsValid())
+        {
+            delete FSlotArr[i].Req;
+            break;
+        }
+
+        FSlotArr[i].Entry = 0;
+        FSlotArr[i].MirrorEntry = 0;
+        FSlotArr[i].Table = 0;
+        FSlotArr[i].MirrorSector = 0;
+        FSlotArr[i].Block = 0;
+        FDepth++;
+    }
+
+    FTableCount = 0;
+    FCurrTable = 0;
+    FSection = 0;
+    FAbort = false;
+    FSynced = 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::~TFatScan
+#
+#   Purpose....: FAT scan destructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatScan::~TFatScan()
+{
+    int i;
+
+    for (i = 0; i < FDepth; i++)
+    {
+        if (FSlotArr[i].Entry)
+            delete FSlotArr[i].Entry;
+
+        if (FSlotArr[i].MirrorEntry)
+            delete FSlotArr[i].MirrorEntry;
+
+        delete FSlotArr[i].Req;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::Add
+#
+#   Purpose....: Add table to scan
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatScan::Add(TFatTable *Table)
+{
+    Add(Table, 0);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::Add
+#
+#   Purpose....: Add table to scan, and compare it with a mirror table.
+#                Blocks that differ are copied to the mirror.
+#                Caller must call BeginScan on the table first
+#
+#   In params..: Table          Table to count
+#                MirrorSector   First sector of mirror, or 0 for none
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatScan::Add(TFatTable *Table, long long MirrorSector)
+{
+    if (FTableCount < FAT_SCAN_TABLES)
+    {
+        FTableArr[FTableCount] = Table;
+        FMirrorArr[FTableCount] = MirrorSector;
+        FNextBlock[FTableCount] = 0;
+        FTableCount++;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::SetSection
+#
+#   Purpose....: Set section that protects the tables. Used when tables
+#                are in use while the scan runs
+#
+#   In params..: Section        Section to enter while a block is counted
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatScan::SetSection(TSection *Section)
+{
+    FSection = Section;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::Abort
+#
+#   Purpose....: Stop issuing new reads. Run returns when reads in
+#                flight are done
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatScan::Abort()
+{
+    FAbort = true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::GetSynced
+#
+#   Purpose....: Get number of mirror sectors that were updated
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFatScan::GetSynced()
+{
+    return FSynced;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::IsValid
+#
+#   Purpose....: Check if any req could be created
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatScan::IsValid()
+{
+    if (FDepth)
+        return true;
+    else
+        return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::Issue
+#
+#   Purpose....: Start read of next block. Tables take turns, so all
+#                tables are read at the same time
+#
+#   In params..: Slot           Free slot
+#   Out params.: *
+#   Returns....: true if a read was started
+#
+##########################################################################*/
+bool TFatScan::Issue(struct TFatScanSlot *Slot)
+{
+    int i;
+    int t;
+    TFatTable *Table;
+    int Sectors;
+
+    if (FAbort)
+        return false;
+
+    for (i = 0; i < FTableCount; i++)
+    {
+        t = (FCurrTable + i) % FTableCount;
+        Table = FTableArr[t];
+
+        if (FNextBlock[t] < Table->GetScanBlocks())
+        {
+            Slot->Table = Table;
+            Slot->Block = FNextBlock[t];
+            Sectors = Table->GetScanSectors(Slot->Block);
+
+            Slot->Entry = new TPartReqEntry(Slot->Req,
+                                            Table->GetScanSector(Slot->Block),
+                                            Sectors);
+
+            if (FMirrorArr[t])
+            {
+                Slot->MirrorSector = FMirrorArr[t] + (long long)Slot->Block * FAT_SCAN_BLOCK_SECTORS;
+                Slot->MirrorEntry = new TPartReqEntry(Slot->Req, Slot->MirrorSector, Sectors);
+            }
+
+            Slot->Req->Start();
+
+            FNextBlock[t]++;
+            FCurrTable = (t + 1) % FTableCount;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::SyncMirror
+#
+#   Purpose....: Compare block with mirror, and copy it if different
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatScan::SyncMirror(struct TFatScanSlot *Slot, char *Data, char *MirrorData)
+{
+    int Sectors = Slot->MirrorEntry->GetSectorCount();
+
+    if (memcmp(Data, MirrorData, 512 * Sectors))
+    {
+        delete Slot->MirrorEntry;
+
+        Slot->MirrorEntry = new TPartReqEntry(Slot->Req, Slot->MirrorSector, Sectors, false);
+        Slot->Req->WaitForever();
+        MirrorData = Slot->MirrorEntry->Map();
+
+        memcpy(MirrorData, Data, 512 * Sectors);
+        Slot->MirrorEntry->Write();
+        FSynced += Sectors;
+    }
+
+    delete Slot->MirrorEntry;
+    Slot->MirrorEntry = 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatScan::Run
+#
+#   Purpose....: Scan tables. Up to FDepth blocks are kept in
+#                flight, and each block is counted (and compared with
+#                its mirror) while later blocks are read. Blocks map the
+#                shared sector buffers, so with a section set, a block
+#                counted inside the section includes table updates made
+#                after it was read
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatScan::Run()
+{
+    int i;
+    int Pending = 0;
+    struct TFatScanSlot *Slot;
+    char *Data;
+
+    for (i = 0; i < FDepth; i++)
+        if (Issue(&FSlotArr[i]))
+            Pending++;
+
+    i = 0;
+
+    while (Pending)
+    {
+        Slot = &FSlotArr[i];
+
+        if (Slot->Entry)
+        {
+            Slot->Req->WaitForever();
+
+            if (FSection)
+                FSection->Enter();
+
+            Data = Slot->Entry->Map();
+
+            if (!FAbort)
+                Slot->Table->ScanBlock(Slot->Block, Data);
+
+            if (Slot->MirrorEntry)
+            {
+                if (FAbort)
+                {
+                    delete Slot->MirrorEntry;
+                    Slot->MirrorEntry = 0;
+                }
+                else
+                    SyncMirror(Slot, Data, Slot->MirrorEntry->Map());
+            }
+
+            if (FSection)
+                FSection->Leave();
+
+            delete Slot->Entry;
+            Slot->Entry = 0;
+            Pending--;
+
+            if (Issue(Slot))
+                Pending++;
+        }
+
+        i = (i + 1) % FDepth;
+    }
+}
@@ -0,0 +1,87 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# fatscan.h
+# Pipelined FAT table scan
+#
+########################################################################*/
+
+#ifndef _FAT_SCAN_H
+#define _FAT_SCAN_H
+
+#include "partint.h"
+#include "section.h"
+#include "tab.h"
+
+#define FAT_SCAN_DEPTH      8
+#define FAT_SCAN_BACKGROUND_DEPTH   2
+#define FAT_SCAN_TABLES     2
+
+struct TFatScanSlot
+{
+    TPartReq *Req;
+    TPartReqEntry *Entry;
+    TPartReqEntry *MirrorEntry;
+    TFatTable *Table;
+    long long MirrorSector;
+    int Block;
+};
+
+class TFatScan
+{
+public:
+    TFatScan(TPartServer *Server, int Depth);
+    ~TFatScan();
+
+    void Add(TFatTable *Table);
+    void Add(TFatTable *Table, long long MirrorSector);
+    void SetSection(TSection *Section);
+    void Abort();
+    void Run();
+
+    int GetSynced();
+    bool IsValid();
+
+protected:
+    bool Issue(struct TFatScanSlot *Slot);
+    void SyncMirror(struct TFatScanSlot *Slot, char *Data, char *MirrorData);
+
+    struct TFatScanSlot FSlotArr[FAT_SCAN_DEPTH];
+    int FDepth;
+
+    TFatTable *FTableArr[FAT_SCAN_TABLES];
+    long long FMirrorArr[FAT_SCAN_TABLES];
+    int FNextBlock[FAT_SCAN_TABLES];
+    int FTableCount;
+    int FCurrTable;
+
+    TSection *FSection;
+    bool FAbort;
+
+    int FSynced;
+};
+
+#endif
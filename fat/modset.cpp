@@ -0,0 +1,360 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# modset.cpp
+# Dirty FAT sector set
+#
+########################################################################*/
+
+#include <memory.h>
+#include "modset.h"
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::TFatModSet
+#
+#   Purpose....: Dirty sector set constructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatModSet::TFatModSet()
+{
+    FServer = 0;
+    FReq = 0;
+    FStartSector = 0;
+    FMirrorSector = 0;
+    FMirror = false;
+    FCount = 0;
+    FWrites = 0;
+    FWrittenSectors = 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::~TFatModSet
+#
+#   Purpose....: Dirty sector set destructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatModSet::~TFatModSet()
+{
+    Flush();
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::Setup
+#
+#   Purpose....: Setup table location
+#
+#   In params..: Server         Partition server
+#                Req            Request to lock sectors with
+#                StartSector    First sector of table
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatModSet::Setup(TPartServer *Server, TPartReq *Req, long long StartSector)
+{
+    Flush();
+
+    FServer = Server;
+    FReq = Req;
+    FStartSector = StartSector;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::SetMirror
+#
+#   Purpose....: Set location of mirror table. Every flushed range is
+#                also copied to the mirror
+#
+#   In params..: MirrorSector   First sector of mirror table
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatModSet::SetMirror(long long MirrorSector)
+{
+    FMirrorSector = MirrorSector;
+    FMirror = true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::Search
+#
+#   Purpose....: Binary search for sector in sorted array
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: Index of sector, or index to insert it at
+#
+##########################################################################*/
+int TFatModSet::Search(int RelSector)
+{
+    int Low = 0;
+    int High = FCount;
+    int Mid;
+
+    while (Low < High)
+    {
+        Mid = (Low + High) / 2;
+
+        if (FSectorArr[Mid].RelSector < RelSector)
+            Low = Mid + 1;
+        else
+            High = Mid;
+    }
+    return Low;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::Find
+#
+#   Purpose....: Find locked sector
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: Sector data, or 0 if not locked
+#
+##########################################################################*/
+char *TFatModSet::Find(int RelSector)
+{
+    int Index = Search(RelSector);
+
+    if (Index < FCount && FSectorArr[Index].RelSector == RelSector)
+        return FSectorArr[Index].Data;
+    else
+        return 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::Lock
+#
+#   Purpose....: Lock sector for modification. If the set is full it
+#                is flushed first
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: Sector data
+#
+##########################################################################*/
+char *TFatModSet::Lock(int RelSector)
+{
+    int Index = Search(RelSector);
+    int i;
+    struct TFatModSector *s;
+
+    if (Index < FCount && FSectorArr[Index].RelSector == RelSector)
+        return FSectorArr[Index].Data;
+
+    if (FCount == FAT_MOD_MAX_SECTORS)
+    {
+        Flush();
+        Index = 0;
+    }
+
+    for (i = FCount; i > Index; i--)
+        FSectorArr[i] = FSectorArr[i - 1];
+
+    FCount++;
+
+    s = &FSectorArr[Index];
+    s->RelSector = RelSector;
+    s->Dirty = false;
+    s->Entry = new TPartReqEntry(FReq, FStartSector + RelSector, 1, false);
+    FReq->WaitForever();
+    s->Data = s->Entry->Map();
+
+    return s->Data;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::SetDirty
+#
+#   Purpose....: Mark locked sector as modified
+#
+#   In params..: RelSector      Sector relative to start of table
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatModSet::SetDirty(int RelSector)
+{
+    int Index = Search(RelSector);
+
+    if (Index < FCount && FSectorArr[Index].RelSector == RelSector)
+        FSectorArr[Index].Dirty = true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::WriteRange
+#
+#   Purpose....: Write a range of adjacent locked sectors, and copy it
+#                to the mirror table
+#
+#   In params..: Index          Array index of first sector
+#                Count          Number of sectors
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatModSet::WriteRange(int Index, int Count)
+{
+    int Start = FSectorArr[Index].RelSector;
+    TPartReqEntry *Entry;
+    char *Data;
+    int i;
+
+    FServer->Write(FStartSector + Start, Count);
+    FWrites++;
+    FWrittenSectors += Count;
+
+    if (FMirror)
+    {
+        Entry = new TPartReqEntry(FReq, FMirrorSector + Start, Count, false);
+        FReq->WaitForever();
+        Data = Entry->Map();
+
+        for (i = 0; i < Count; i++)
+            memcpy(Data + 512 * i, FSectorArr[Index + i].Data, 512);
+
+        FServer->Write(FMirrorSector + Start, Count);
+        FWrites++;
+        FWrittenSectors += Count;
+
+        delete Entry;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::Flush
+#
+#   Purpose....: Write modified sectors in sector order, merging adjacent
+#                sectors into a single write, and release all locks.
+#                With a mirror, each merged range is copied to it as well
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatModSet::Flush()
+{
+    int i;
+    int Index = 0;
+    int Count = 0;
+    struct TFatModSector *s;
+
+    for (i = 0; i < FCount; i++)
+    {
+        s = &FSectorArr[i];
+
+        if (s->Dirty)
+        {
+            if (Count && s->RelSector == FSectorArr[Index].RelSector + Count)
+                Count++;
+            else
+            {
+                if (Count)
+                    WriteRange(Index, Count);
+
+                Index = i;
+                Count = 1;
+            }
+        }
+    }
+
+    if (Count)
+        WriteRange(Index, Count);
+
+    for (i = 0; i < FCount; i++)
+        delete FSectorArr[i].Entry;
+
+    FCount = 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::GetCount
+#
+#   Purpose....: Get number of locked sectors
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFatModSet::GetCount()
+{
+    return FCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::GetWrites
+#
+#   Purpose....: Get number of write operations issued
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatModSet::GetWrites()
+{
+    return FWrites;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatModSet::GetWrittenSectors
+#
+#   Purpose....: Get number of sectors written
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatModSet::GetWrittenSectors()
+{
+    return FWrittenSectors;
+}
@@ -0,0 +1,82 @@
+/*#######################################################################
+# RDOS operating system
+# Copyright (C) 1988-2025, Leif Ekblad
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# The author of this program may be contacted at leif@rdos.net
+#
+# modset.h
+# Dirty FAT sector set
+#
+########################################################################*/
+
+#ifndef _FAT_MODSET_H
+#define _FAT_MODSET_H
+
+#include "partint.h"
+
+#define FAT_MOD_MAX_SECTORS     64
+
+struct TFatModSector
+{
+    int RelSector;
+    bool Dirty;
+    TPartReqEntry *Entry;
+    char *Data;
+};
+
+class TFatModSet
+{
+public:
+    TFatModSet();
+    ~TFatModSet();
+
+    void Setup(TPartServer *Server, TPartReq *Req, long long StartSector);
+    void SetMirror(long long MirrorSector);
+
+    char *Find(int RelSector);
+    char *Lock(int RelSector);
+    void SetDirty(int RelSector);
+    void Flush();
+
+    int GetCount();
+    unsigned int GetWrites();
+    unsigned int GetWrittenSectors();
+
+protected:
+    int Search(int RelSector);
+    void WriteRange(int Index, int Count);
+
+    TPartServer *FServer;
+    TPartReq *FReq;
+    long long FStartSector;
+    long long FMirrorSector;
+    bool FMirror;
+
+    struct TFatModSector FSectorArr[FAT_MOD_MAX_SECTORS];
+    int FCount;
+
+    unsigned int FWrites;
+    unsigned int FWrittenSectors;
+};
+
+#endif
@@ -29,6 +29,7 @@
 #
 ########################################################################*/
 
+#include <memory.h>
 #include "tab.h"
 
 /*##########################################################################
@@ -45,11 +46,16 @@
 TFatTable::TFatTable(TPartServer *Server)
  :  FReq(Server)
 {
+    FServer = Server;
     FAllocateCluster = 2;
     FSectorsPerCluster = 0;
     FStartSector = 0;
+    FFatSectors = 0;
+    FClustersPerSector = 0;
+    FScanCluster = 0xFFFFFFFF;
     FClusters = 0;
     FWrite = false;
+    FCacheSize = FAT_CACHE_DEFAULT_SECTORS;
 }
 
 /*##########################################################################
@@ -83,6 +89,273 @@ void TFatTable::SetAllocateCluster(unsigned int Cluster)
     FAllocateCluster = Cluster;
 }
 
+/*##########################################################################
+#
+#   Name       : TFatTable::GetAllocateCluster
+#
+#   Purpose....: Get start of allocation cluster
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatTable::GetAllocateCluster()
+{
+    return FAllocateCluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::SetCacheSize
+#
+#   Purpose....: Set sector budget of cache. Must be called before Setup
+#
+#   In params..: Sectors        Max cached sectors
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::SetCacheSize(int Sectors)
+{
+    FCacheSize = Sectors;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetCache
+#
+#   Purpose....: Get cache
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatCache *TFatTable::GetCache()
+{
+    return &FCache;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetModSet
+#
+#   Purpose....: Get dirty sector set
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatModSet *TFatTable::GetModSet()
+{
+    return &FModSet;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetBitmap
+#
+#   Purpose....: Get free cluster bitmap
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFatBitmap *TFatTable::GetBitmap()
+{
+    return &FBitmap;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::SetMirror
+#
+#   Purpose....: Copy all flushed sectors to a mirror table
+#
+#   In params..: MirrorSector   First sector of mirror table
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::SetMirror(long long MirrorSector)
+{
+    FModSet.SetMirror(MirrorSector);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetFreeCount
+#
+#   Purpose....: Get free clusters found by last scan, less allocations
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatTable::GetFreeCount()
+{
+    return FFreeClusters;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetScanCluster
+#
+#   Purpose....: Get first cluster not yet scanned
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatTable::GetScanCluster()
+{
+    return FScanCluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::IsScanned
+#
+#   Purpose....: Check if free count and bitmap cover the whole table
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatTable::IsScanned()
+{
+    if (FScanCluster >= FClusters)
+        return true;
+    else
+        return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::BeginScan
+#
+#   Purpose....: Reset free count and bitmap before scanning blocks.
+#                Until the scan is done, free count and bitmap only
+#                cover clusters below the scan position
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::BeginScan()
+{
+    FFreeClusters = 0;
+    FScanCluster = 0;
+    FBitmap.Setup(FClusters);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetScanBlocks
+#
+#   Purpose....: Get number of scan blocks that hold cluster entries
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFatTable::GetScanBlocks()
+{
+    unsigned int BlockClusters = FAT_SCAN_BLOCK_SECTORS * FClustersPerSector;
+
+    if (BlockClusters)
+        return (FClusters + BlockClusters - 1) / BlockClusters;
+    else
+        return 0;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetScanSector
+#
+#   Purpose....: Get first sector of scan block
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+long long TFatTable::GetScanSector(int Block)
+{
+    return FStartSector + (long long)Block * FAT_SCAN_BLOCK_SECTORS;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetScanSectors
+#
+#   Purpose....: Get number of sectors in scan block
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFatTable::GetScanSectors(int Block)
+{
+    int Count = FFatSectors - Block * FAT_SCAN_BLOCK_SECTORS;
+
+    if (Count > FAT_SCAN_BLOCK_SECTORS)
+        Count = FAT_SCAN_BLOCK_SECTORS;
+
+    return Count;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::ScanBlock
+#
+#   Purpose....: Count free clusters in a scan block and add them to
+#                the bitmap
+#
+#   In params..: Block          Block number
+#                Data           Block contents
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::ScanBlock(int Block, char *Data)
+{
+    unsigned int Cluster = Block * FAT_SCAN_BLOCK_SECTORS * FClustersPerSector;
+    unsigned int Count = FClusters - Cluster;
+
+    if (Count > FAT_SCAN_BLOCK_SECTORS * FClustersPerSector)
+        Count = FAT_SCAN_BLOCK_SECTORS * FClustersPerSector;
+
+    FFreeClusters += CountFree(Data, Cluster, Count);
+    FScanCluster = Cluster + Count;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::CountFree
+#
+#   Purpose....: Count free entries in table data. Tables that support
+#                block scans override this
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+unsigned int TFatTable::CountFree(const char *Data, unsigned int Cluster, unsigned int Clusters)
+{
+    return 0;
+}
+
 /*##########################################################################
 #
 #   Name       : TFatTable::IsFree
@@ -96,8 +369,182 @@ void TFatTable::SetAllocateCluster(unsigned int Cluster)
 ##########################################################################*/
 bool TFatTable::IsFree(unsigned int Cluster)
 {
+    if (FBitmap.IsValid())
+        return FBitmap.IsFree(Cluster);
+
     if (GetClusterLink(Cluster))
         return false;
     else
         return true;
 }
+
+/*##########################################################################
+#
+#   Name       : TFatTable::AllocateRun
+#
+#   Purpose....: Allocate a run of contiguous clusters. Default is a
+#                single cluster for tables without a free cluster bitmap
+#
+#   In params..: Count          Wanted clusters
+#   Out params.: Size           Allocated clusters
+#   Returns....: First cluster, or 0 if none could be allocated
+#
+##########################################################################*/
+unsigned int TFatTable::AllocateRun(unsigned int Count, unsigned int *Size)
+{
+    unsigned int Cluster = AllocateCluster();
+
+    if (Cluster)
+        *Size = 1;
+    else
+        *Size = 0;
+
+    return Cluster;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetRun
+#
+#   Purpose....: Follow chain while it is contiguous. Links are read
+#                in batches
+#
+#   In params..: Cluster        First cluster of run
+#   Out params.: Count          Clusters in run
+#   Returns....: Link of last cluster in run
+#
+##########################################################################*/
+unsigned int TFatTable::GetRun(unsigned int Cluster, unsigned int *Count)
+{
+    unsigned int Links[16];
+    unsigned int Link;
+    unsigned int Size;
+    unsigned int i;
+
+    *Count = 0;
+
+    for (;;)
+    {
+        Size = GetLinks(Cluster, 16, Links);
+
+        for (i = 0; i < Size; i++)
+        {
+            Link = Links[i];
+            (*Count)++;
+
+            if (Link != Cluster + 1 || Link >= FClusters)
+                return Link;
+
+            Cluster = Link;
+        }
+
+        if (!Size)
+            return 0;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::GetLinks
+#
+#   Purpose....: Read links of consecutive clusters
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of entries
+#   Out params.: Links          Link of each cluster
+#   Returns....: Number of links read
+#
+##########################################################################*/
+unsigned int TFatTable::GetLinks(unsigned int Cluster, unsigned int Count, unsigned int *Links)
+{
+    unsigned int i;
+
+    if (Cluster >= FClusters)
+        return 0;
+
+    if (Count > FClusters - Cluster)
+        Count = FClusters - Cluster;
+
+    for (i = 0; i < Count; i++)
+        Links[i] = GetClusterLink(Cluster + i);
+
+    return Count;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::LinkRun
+#
+#   Purpose....: Link consecutive clusters into a contiguous chain that
+#                ends at the last cluster
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::LinkRun(unsigned int Cluster, unsigned int Count)
+{
+    unsigned int i;
+
+    if (Count)
+    {
+        for (i = 1; i < Count; i++)
+            LinkCluster(Cluster + i - 1, Cluster + i);
+
+        LinkCluster(Cluster + Count - 1);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::FreeRun
+#
+#   Purpose....: Free consecutive clusters
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::FreeRun(unsigned int Cluster, unsigned int Count)
+{
+    unsigned int i;
+
+    for (i = 0; i < Count; i++)
+        FreeCluster(Cluster + i);
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::IsClean
+#
+#   Purpose....: Check clean shutdown flag. Tables without one are
+#                always clean
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatTable::IsClean()
+{
+    return true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable::SetClean
+#
+#   Purpose....: Set clean shutdown flag
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable::SetClean(bool Clean)
+{
+}
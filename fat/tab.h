@@ -33,6 +33,11 @@
 #define _FAT_TAB_H
 
 #include "partint.h"
+#include "bitmap.h"
+#include "fatcache.h"
+#include "modset.h"
+
+#define FAT_SCAN_BLOCK_SECTORS  64
 
 class TFatTable
 {
@@ -41,6 +46,23 @@ public:
     virtual ~TFatTable();
 
     void SetAllocateCluster(unsigned int Cluster);
+    unsigned int GetAllocateCluster();
+    void SetCacheSize(int Sectors);
+    TFatCache *GetCache();
+    TFatModSet *GetModSet();
+    TFatBitmap *GetBitmap();
+
+    void SetMirror(long long MirrorSector);
+
+    unsigned int GetFreeCount();
+    unsigned int GetScanCluster();
+    bool IsScanned();
+
+    void BeginScan();
+    int GetScanBlocks();
+    long long GetScanSector(int Block);
+    int GetScanSectors(int Block);
+    void ScanBlock(int Block, char *Data);
     bool IsFree(unsigned int Cluster);
 
     virtual unsigned int GetClusterLink(unsigned int Cluster) = 0;
@@ -48,25 +70,42 @@ public:
     virtual unsigned int FormatClusters() = 0;
 
     virtual unsigned int AllocateCluster() = 0;
+    virtual unsigned int AllocateRun(unsigned int Count, unsigned int *Size);
+    virtual unsigned int GetRun(unsigned int Cluster, unsigned int *Count);
+    virtual unsigned int GetLinks(unsigned int Cluster, unsigned int Count, unsigned int *Links);
+    virtual void LinkRun(unsigned int Cluster, unsigned int Count);
+    virtual void FreeRun(unsigned int Cluster, unsigned int Count);
     virtual bool ReserveCluster(unsigned int Cluster) = 0;
     virtual void LinkCluster(unsigned int Cluster, unsigned int Link) = 0;
     virtual void LinkCluster(unsigned int Cluster) = 0;
     virtual void FreeCluster(unsigned int Cluster) = 0;
     virtual void Complete() = 0;
 
+    virtual bool IsClean();
+    virtual void SetClean(bool Clean);
+
 protected:
+    virtual unsigned int CountFree(const char *Data, unsigned int Cluster, unsigned int Clusters);
+
+    TPartServer *FServer;
     long long FStartSector;
+    int FFatSectors;
+    int FClustersPerSector;
     int FSectorsPerCluster;
     TPartReq FReq;
 
-    unsigned int FStartCluster;
     unsigned int FAllocateCluster;
 
     unsigned int FClusters;
     unsigned int FFreeClusters;
-    int FCachedSectors;
-    int FCachedClusters;
+    unsigned int FScanCluster;
     bool FWrite;
+
+    int FCacheSize;
+    TFatCache FCache;
+    TFatModSet FModSet;
+
+    TFatBitmap FBitmap;
 };
 
 #endif
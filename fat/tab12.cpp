@@ -31,6 +31,7 @@
 
 #include <memory.h>
 #include "tab12.h"
+#include "fatkern.h"
 
 /*##########################################################################
 #
@@ -46,10 +47,6 @@
 TFatTable12::TFatTable12(TPartServer *Server)
  :  TFatTable(Server)
 {
-    FReqEntry = 0;
-    FTab = 0;
-
-    SetCacheSize(3);
 }
 
 /*##########################################################################
@@ -82,6 +79,7 @@ void TFatTable12::Setup(int SectorsPerCluster, long long StartSector, int FatSec
 {
     FSectorsPerCluster = SectorsPerCluster;
     FStartSector = StartSector;
+    FFatSectors = FatSectors;
 
     if (FatSectors * 512 * 2 / 3 < Clusters)
         FClusters = FatSectors * 512 * 2 / 3;
@@ -89,23 +87,8 @@ void TFatTable12::Setup(int SectorsPerCluster, long long StartSector, int FatSec
         FClusters = Clusters;
 
     FFreeClusters = 0;
-}
 
-/*##########################################################################
-#
-#   Name       : TFatTable12::SetCacheSize
-#
-#   Purpose....: Set cache size
-#
-#   In params..: *
-#   Out params.: *
-#   Returns....: *
-#
-##########################################################################*/
-void TFatTable12::SetCacheSize(int size)
-{
-    FCachedSectors = size;
-    FCachedClusters = size * 512 * 2 / 3;
+    FCache.Setup(&FReq, StartSector, FatSectors, 3, FCacheSize);
 }
 
 /*##########################################################################
@@ -122,36 +105,25 @@ void TFatTable12::SetCacheSize(int size)
 unsigned int TFatTable12::GetFreeInBlock(long long Sector, unsigned int Clusters)
 {
     unsigned int i;
+    unsigned int Count;
     unsigned int fc = 0;
     TPartReqEntry e1(&FReq, Sector, 3);
     char *tab;
-    unsigned int val;
+    unsigned short int Entries[FAT_KERNEL_CHUNK];
+    unsigned int Mask[FAT_KERNEL_CHUNK / 32];
 
     FReq.WaitForever();
 
     tab = (char *)e1.Map();
 
-    i = 0;
-
-    while (i < Clusters)
+    for (i = 0; i < Clusters; i += Count)
     {
-        val = 0;
-        memcpy(&val, tab, 3);
-        tab += 3;
-        i += 2;
-
-        if (val == 0)
-            fc += 2;
-        else
-        {
-            if ((val & 0xFFF) == 0)
-                fc++;
-
-            val = val >> 12;
+        Count = Clusters - i;
+        if (Count > FAT_KERNEL_CHUNK)
+            Count = FAT_KERNEL_CHUNK;
 
-            if ((val & 0xFFF) == 0)
-                fc++;
-        }
+        FatUnpack12(tab + i / 2 * 3, Entries, Count);
+        fc += FatFreeMask16(Entries, Mask, Count);
     }
 
     return fc;
@@ -222,43 +194,27 @@ unsigned int TFatTable12::FormatClusters()
 unsigned int TFatTable12::GetClusterLink(unsigned int Cluster)
 {
     int RelSector;
-    long long Sector;
+    char *Tab;
     int pos;
     unsigned short int *shp;
     unsigned short int val;
 
-    if (FReqEntry)
-    {
-        if (Cluster < FStartCluster || Cluster >= FStartCluster + FCachedClusters)
-        {
-            delete FReqEntry;
-            FReqEntry = 0;
-        }
-    }
+    RelSector = Cluster / 512 * 3 / 2;
+    while ((RelSector % 3) != 0)
+        RelSector--;
 
-    if (!FReqEntry)
-    {
-        RelSector = Cluster / 512 * 3 / 2;
-        while ((RelSector % 3) != 0)
-            RelSector--;
-
-        FStartCluster = RelSector * 512 / 3 * 2;
-        Sector = FStartSector + RelSector;
-        FReqEntry = new TPartReqEntry(&FReq, Sector, FCachedSectors);
-        FReq.WaitForever();
-        FTab = (char *)FReqEntry->Map();
-    }
+    Tab = FCache.GetSector(RelSector);
 
-    pos = 3 * (Cluster - FStartCluster);
+    pos = 3 * (Cluster - RelSector * 512 / 3 * 2);
     if ((pos % 2) == 0)
     {
-        shp = (unsigned short int *)(FTab + pos / 2);
+        shp = (unsigned short int *)(Tab + pos / 2);
         val = *shp;
         return val & 0xFFF;
     }
     else
     {
-        shp = (unsigned short int *)(FTab + pos / 2);
+        shp = (unsigned short int *)(Tab + pos / 2);
         val = *shp;
         val = val >> 4;
         return val & 0xFFF;
@@ -52,13 +52,9 @@ public:
     virtual void Complete();
 
     void Setup(int SectorsPerCluster, long long StartSector, int FatSectors, unsigned int Clusters);
-    void SetCacheSize(int size);
 
 protected:
     unsigned int GetFreeInBlock(long long Sector, unsigned int Clusters);
-
-    TPartReqEntry *FReqEntry;
-    char *FTab;
 };
 
 #endif
@@ -31,6 +31,8 @@
 
 #include <memory.h>
 #include "tab16.h"
+#include "fatscan.h"
+#include "fatkern.h"
 
 /*##########################################################################
 #
@@ -46,13 +48,9 @@
 TFatTable16::TFatTable16(TPartServer *Server)
  :  TFatTable(Server)
 {
-    FReqEntry = 0;
-    FTab = 0;
+    FClustersPerSector = 512 / 2;
     FAllocateCluster = 2;
-    FModReq = 0;
     FModTab = 0;
-
-    SetCacheSize(4);
 }
 
 /*##########################################################################
@@ -85,6 +83,7 @@ void TFatTable16::Setup(int SectorsPerCluster, long long StartSector, int FatSec
 {
     FSectorsPerCluster = SectorsPerCluster;
     FStartSector = StartSector;
+    FFatSectors = FatSectors;
 
     if (FatSectors * 512 / 2 < Clusters)
         FClusters = FatSectors * 512 / 2;
@@ -92,50 +91,43 @@ void TFatTable16::Setup(int SectorsPerCluster, long long StartSector, int FatSec
         FClusters = Clusters;
 
     FFreeClusters = 0;
-}
 
-/*##########################################################################
-#
-#   Name       : TFatTable16::SetCacheSize
-#
-#   Purpose....: Set cache size
-#
-#   In params..: *
-#   Out params.: *
-#   Returns....: *
-#
-##########################################################################*/
-void TFatTable16::SetCacheSize(int size)
-{
-    FCachedSectors = size;
-    FCachedClusters = size * 512 / 2;
+    FCache.Setup(&FReq, StartSector, FatSectors, 1, FCacheSize);
+    FModSet.Setup(FServer, &FReq, StartSector);
 }
 
 /*##########################################################################
 #
-#   Name       : TFatTable16::GetFreeInBlock
+#   Name       : TFatTable16::CountFree
 #
-#   Purpose....: Get free clusters in block
+#   Purpose....: Count free clusters in table data, and mark them in
+#                the bitmap. Cluster must be a multiple of 32
 #
 #   In params..: *
 #   Out params.: *
 #   Returns....: *
 #
 ##########################################################################*/
-unsigned int TFatTable16::GetFreeInBlock(long long Sector, unsigned int Clusters)
+unsigned int TFatTable16::CountFree(const char *Data, unsigned int Cluster, unsigned int Clusters)
 {
-    unsigned int i;
+    unsigned int Mask[FAT_KERNEL_CHUNK / 32];
+    unsigned int Count;
     unsigned int fc = 0;
-    TPartReqEntry e1(&FReq, Sector, 8);
-    short int *tab;
+    const unsigned short int *tab = (const unsigned short int *)Data;
 
-    FReq.WaitForever();
+    while (Clusters)
+    {
+        Count = Clusters;
+        if (Count > FAT_KERNEL_CHUNK)
+            Count = FAT_KERNEL_CHUNK;
 
-    tab = (short int *)e1.Map();
+        fc += FatFreeMask16(tab, Mask, Count);
+        FBitmap.SetFreeMask(Cluster, Mask, (Count + 31) / 32);
 
-    for (i = 0; i < Clusters; i++)
-        if (tab[i] == 0)
-            fc++;
+        tab += Count;
+        Cluster += Count;
+        Clusters -= Count;
+    }
 
     return fc;
 }
@@ -153,24 +145,11 @@ unsigned int TFatTable16::GetFreeInBlock(long long Sector, unsigned int Clusters
 ##########################################################################*/
 unsigned int TFatTable16::GetFreeClusters()
 {
-    int i;
-    long long Sector = FStartSector;
-    unsigned int Cluster = 0;
-    int Count;
-    int Blocks = FClusters / 512 * 2 / 8;
-
-    FFreeClusters = 0;
-
-    for (i = 0; i <= Blocks; i++)
-    {
-        Count = FClusters - Cluster;
-        if (Count > 512 * 8 / 2)
-            Count = 512 * 8 / 2;
+    TFatScan Scan(FServer);
 
-        FFreeClusters += GetFreeInBlock(Sector, Count);
-        Sector += 8;
-        Cluster += Count;
-    }
+    BeginScan();
+    Scan.Add(this);
+    Scan.Run();
 
     return FFreeClusters;
 }
@@ -263,125 +242,125 @@ unsigned int TFatTable16::FormatClusters()
 ##########################################################################*/
 void TFatTable16::ClearMod()
 {
-    if (FModReq)
+    if (FModTab)
     {
         if (FWrite)
-            FModReq->Write();
+            FModSet.SetDirty(FModCluster / (512 / 2));
 
         FWrite = false;
-        delete FModReq;
-        FModReq = 0;
+        FModTab = 0;
     }
 }
 
 /*##########################################################################
 #
-#   Name       : TFatTable16::ClearCache
+#   Name       : TFatTable16::SetupMod
 #
-#   Purpose....: Clear cache
+#   Purpose....: Setup modification
 #
 #   In params..: *
 #   Out params.: *
 #   Returns....: *
 #
 ##########################################################################*/
-void TFatTable16::ClearCache()
+void TFatTable16::SetupMod(unsigned int Cluster)
 {
-    if (FReqEntry)
+    int RelSector;
+
+    if (!FModTab || Cluster < FModCluster || Cluster >= FModCluster + 512 / 2)
     {
-        delete FReqEntry;
-        FReqEntry = 0;
+        ClearMod();
+
+        RelSector = Cluster / (512 / 2);
+        FModCluster = RelSector * 512 / 2;
+
+        FModTab = (unsigned short int *)FModSet.Find(RelSector);
+        if (!FModTab)
+        {
+            FCache.Invalidate(RelSector);
+            FModTab = (unsigned short int *)FModSet.Lock(RelSector);
+        }
     }
 }
 
 /*##########################################################################
 #
-#   Name       : TFatTable16::SetupCache
+#   Name       : TFatTable16::GetClusterLink
 #
-#   Purpose....: Setup cache
+#   Purpose....: Get cluster link
 #
 #   In params..: *
 #   Out params.: *
 #   Returns....: *
 #
 ##########################################################################*/
-void TFatTable16::SetupCache(unsigned int Cluster)
+unsigned int TFatTable16::GetClusterLink(unsigned int Cluster)
 {
-    int RelSector;
-    long long Sector;
+    int RelSector = Cluster / (512 / 2);
+    unsigned short int *Tab;
 
-    if (FReqEntry)
-    {
-        if (Cluster < FStartCluster || Cluster >= FStartCluster + FCachedClusters)
-        {
-            delete FReqEntry;
-            FReqEntry = 0;
-        }
-    }
-
-    if (FModReq)
-        ClearMod();
+    Tab = (unsigned short int *)FModSet.Find(RelSector);
+    if (!Tab)
+        Tab = (unsigned short int *)FCache.GetSector(RelSector);
 
-    if (!FReqEntry)
-    {
-        RelSector = Cluster / 512 * 2;
-        FStartCluster = RelSector * 512 / 2;
-        Sector = FStartSector + RelSector;
-        FReqEntry = new TPartReqEntry(&FReq, Sector, FCachedSectors);
-        FReq.WaitForever();
-        FTab = (unsigned short int *)FReqEntry->Map();
-    }
+    return Tab[Cluster % (512 / 2)];
 }
 
 /*##########################################################################
 #
-#   Name       : TFatTable16::SetupMod
+#   Name       : TFatTable16::GetRun
 #
-#   Purpose....: Setup modification
+#   Purpose....: Follow chain while it is contiguous. Entries are read
+#                directly from the table sector, and the window that
+#                the chain continues in is read ahead
 #
-#   In params..: *
-#   Out params.: *
-#   Returns....: *
+#   In params..: Cluster        First cluster of run
+#   Out params.: Count          Clusters in run
+#   Returns....: Link of last cluster in run
 #
 ##########################################################################*/
-void TFatTable16::SetupMod(unsigned int Cluster)
+unsigned int TFatTable16::GetRun(unsigned int Cluster, unsigned int *Count)
 {
     int RelSector;
-    long long Sector;
+    unsigned int End;
+    unsigned int Link;
+    unsigned short int *Tab;
 
-    if (FReqEntry)
-        ClearCache();
+    *Count = 0;
 
-    if (!FModReq || Cluster < FModCluster || Cluster >= FModCluster + 512 / 2)
+    for (;;)
     {
-        if (FModReq)
-            ClearMod();
-
         RelSector = Cluster / (512 / 2);
-        FModCluster = RelSector * 512 / 2;
-        Sector = FStartSector + RelSector;
+        End = (RelSector + 1) * (512 / 2);
 
-        FModReq = new TPartReqEntry(&FReq, Sector, 1, false);
-        FReq.WaitForever();
-        FModTab = (unsigned short int *)FModReq->Map();
-    }
-}
+        Tab = (unsigned short int *)FModSet.Find(RelSector);
+        if (!Tab)
+        {
+            Tab = (unsigned short int *)FCache.GetSector(RelSector);
 
-/*##########################################################################
-#
-#   Name       : TFatTable16::GetClusterLink
-#
-#   Purpose....: Get cluster link
-#
-#   In params..: *
-#   Out params.: *
-#   Returns....: *
-#
-##########################################################################*/
-unsigned int TFatTable16::GetClusterLink(unsigned int Cluster)
-{
-    SetupCache(Cluster);
-    return FTab[Cluster - FStartCluster];
+            if ((RelSector + 1) % FCache.GetWindowSectors() == 0)
+                FCache.Prefetch(RelSector + 1);
+        }
+
+        for (;;)
+        {
+            Link = Tab[Cluster % (512 / 2)];
+            (*Count)++;
+
+            if (Link != Cluster + 1 || Link >= FClusters)
+            {
+                if (Link >= 2 && Link < FClusters)
+                    if (!FModSet.Find(Link / (512 / 2)))
+                        FCache.Prefetch(Link / (512 / 2));
+
+                return Link;
+            }
+
+            Cluster = Link;
+            if (Cluster == End)
+                break;
+        }
+    }
 }
 
 /*##########################################################################
@@ -403,23 +382,57 @@ unsigned int TFatTable16::AllocateCluster()
     int i;
     bool Restarted = false;
 
-    if (FFreeClusters == 0)
+    if (FFreeClusters == 0 && IsScanned())
         return 0;
 
+    if (FBitmap.IsValid())
+    {
+        for (;;)
+        {
+            Cluster = FBitmap.FindFree(FAllocateCluster);
+            if (!Cluster)
+            {
+                if (!IsScanned())
+                    break;
+
+                FFreeClusters = 0;
+                return 0;
+            }
+
+            FBitmap.SetUsed(Cluster);
+            SetupMod(Cluster);
+
+            if (FModTab[Cluster - FModCluster] == 0)
+            {
+                FModTab[Cluster - FModCluster] = 0xFFFF;
+                FWrite = true;
+                FAllocateCluster = Cluster + 1;
+                FFreeClusters--;
+                return Cluster;
+            }
+            else
+                FAllocateCluster = Cluster + 1;
+        }
+
+        Cluster = 0;
+        FAllocateCluster = FScanCluster;
+    }
+
     for (;;)
     {
         SetupMod(FAllocateCluster);
 
         offset = FAllocateCluster % (512 / 2);
-        size = (256 / 2) - offset;
+        size = (512 / 2) - offset;
 
-        for (i = 0; i < size; i++)
+        if (FModCluster + offset + size > FClusters)
+            size = (int)(FClusters - FModCluster) - offset;
+
+        if (size > 0)
         {
-            if (FModTab[i + offset] == 0)
-            {
+            i = FatFindFree16(FModTab + offset, size);
+            if (i >= 0)
                 Cluster = FModCluster + i + offset;
-                break;
-            }
         }
 
         if (Cluster)
@@ -427,7 +440,12 @@ unsigned int TFatTable16::AllocateCluster()
             FModTab[Cluster - FModCluster] = 0xFFFF;
             FWrite = true;
             FAllocateCluster = Cluster + 1;
-            FFreeClusters--;
+
+            if (Cluster < FScanCluster)
+            {
+                FBitmap.SetUsed(Cluster);
+                FFreeClusters--;
+            }
             return Cluster;
         }
 
@@ -447,6 +465,154 @@ unsigned int TFatTable16::AllocateCluster()
     }
 }
 
+/*##########################################################################
+#
+#   Name       : TFatTable16::AllocateRun
+#
+#   Purpose....: Allocate a run of contiguous clusters from the bitmap.
+#                Every cluster is marked as end-of-chain, and the caller
+#                links the run.
+#
+#   In params..: Count          Wanted clusters
+#   Out params.: Size           Allocated clusters
+#   Returns....: First cluster, or 0 if none could be allocated
+#
+##########################################################################*/
+unsigned int TFatTable16::AllocateRun(unsigned int Count, unsigned int *Size)
+{
+    unsigned int Cluster;
+    unsigned int Len;
+    unsigned int i;
+
+    if (Count <= 1 || !FBitmap.IsValid())
+        return TFatTable::AllocateRun(Count, Size);
+
+    *Size = 0;
+
+    if (FFreeClusters == 0 && IsScanned())
+        return 0;
+
+    for (;;)
+    {
+        Cluster = FBitmap.FindRun(FAllocateCluster, Count, &Len);
+        if (!Cluster)
+        {
+            if (!IsScanned())
+                return AllocateTableRun(Count, Size);
+
+            FFreeClusters = 0;
+            return 0;
+        }
+
+        for (i = 0; i < Len; i++)
+        {
+            FBitmap.SetUsed(Cluster + i);
+            SetupMod(Cluster + i);
+
+            if (FModTab[Cluster + i - FModCluster] != 0)
+                break;
+
+            FModTab[Cluster + i - FModCluster] = 0xFFFF;
+            FWrite = true;
+            FFreeClusters--;
+        }
+
+        if (i < Len)
+            FAllocateCluster = Cluster + i + 1;
+        else
+            FAllocateCluster = Cluster + i;
+
+        if (i)
+        {
+            *Size = i;
+            return Cluster;
+        }
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable16::AllocateTableRun
+#
+#   Purpose....: Allocate longest run of free clusters in the first table
+#                sector that has any, searching the table directly. Used
+#                while the bitmap does not cover the whole table
+#
+#   In params..: Count          Wanted clusters
+#   Out params.: Size           Allocated clusters
+#   Returns....: First cluster, or 0 if none could be allocated
+#
+##########################################################################*/
+unsigned int TFatTable16::AllocateTableRun(unsigned int Count, unsigned int *Size)
+{
+    unsigned int Mask[(512 / 2) / 32];
+    unsigned int Cluster;
+    unsigned int Entries;
+    unsigned int Start;
+    unsigned int Len;
+    unsigned int offset;
+    unsigned int i;
+    bool Restarted = false;
+
+    *Size = 0;
+
+    for (;;)
+    {
+        SetupMod(FAllocateCluster);
+
+        offset = FAllocateCluster - FModCluster;
+        Entries = 512 / 2;
+
+        if (FModCluster + Entries > FClusters)
+            Entries = FClusters - FModCluster;
+
+        if (offset < Entries)
+        {
+            FatFreeMask16(FModTab, Mask, Entries);
+
+            for (i = 0; i < offset; i++)
+                Mask[i >> 5] &= ~(1 << (i & 0x1F));
+
+            Len = FatFindRun(Mask, Entries, &Start);
+
+            if (Len)
+            {
+                if (Len > Count)
+                    Len = Count;
+
+                Cluster = FModCluster + Start;
+
+                for (i = 0; i < Len; i++)
+                {
+                    FModTab[Start + i] = 0xFFFF;
+
+                    if (Cluster + i < FScanCluster)
+                    {
+                        FBitmap.SetUsed(Cluster + i);
+                        FFreeClusters--;
+                    }
+                }
+
+                FWrite = true;
+                FAllocateCluster = Cluster + Len;
+                *Size = Len;
+                return Cluster;
+            }
+        }
+
+        FAllocateCluster = FModCluster + 512 / 2;
+        if (FAllocateCluster >= FClusters)
+        {
+            FAllocateCluster = 2;
+
+            if (Restarted)
+                return 0;
+            else
+                Restarted = true;
+        }
+    }
+}
+
 /*##########################################################################
 #
 #   Name       : TFatTable16::ReserveCluster
@@ -466,7 +632,12 @@ bool TFatTable16::ReserveCluster(unsigned int Cluster)
     {
         FModTab[Cluster - FModCluster] = 0xFFFF;
         FWrite = true;
-        FFreeClusters--;
+
+        if (Cluster < FScanCluster)
+        {
+            FBitmap.SetUsed(Cluster);
+            FFreeClusters--;
+        }
         return true;
     }
     else
@@ -524,8 +695,145 @@ void TFatTable16::FreeCluster(unsigned int Cluster)
 {
     SetupMod(Cluster);
     FModTab[Cluster - FModCluster] = 0;
-    FFreeClusters++;
     FWrite = true;
+
+    if (Cluster < FScanCluster)
+    {
+        FBitmap.SetFree(Cluster);
+        FFreeClusters++;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable16::GetLinks
+#
+#   Purpose....: Read links of consecutive clusters, one table sector
+#                at a time
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of entries
+#   Out params.: Links          Link of each cluster
+#   Returns....: Number of links read
+#
+##########################################################################*/
+unsigned int TFatTable16::GetLinks(unsigned int Cluster, unsigned int Count, unsigned int *Links)
+{
+    int RelSector;
+    unsigned int Index;
+    unsigned int Done;
+    unsigned short int *Tab;
+
+    if (Cluster >= FClusters)
+        return 0;
+
+    if (Count > FClusters - Cluster)
+        Count = FClusters - Cluster;
+
+    Done = 0;
+
+    while (Done < Count)
+    {
+        RelSector = Cluster / (512 / 2);
+
+        Tab = (unsigned short int *)FModSet.Find(RelSector);
+        if (!Tab)
+            Tab = (unsigned short int *)FCache.GetSector(RelSector);
+
+        for (Index = Cluster % (512 / 2); Index < (512 / 2) && Done < Count; Index++)
+        {
+            Links[Done] = Tab[Index];
+            Done++;
+            Cluster++;
+        }
+    }
+
+    return Count;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable16::LinkRun
+#
+#   Purpose....: Link consecutive clusters into a contiguous chain that
+#                ends at the last cluster. Each table sector is set up
+#                once and filled with the link run kernel
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable16::LinkRun(unsigned int Cluster, unsigned int Count)
+{
+    unsigned int End = Cluster + Count;
+    unsigned int SectorEnd;
+
+    while (Cluster < End)
+    {
+        SetupMod(Cluster);
+
+        SectorEnd = FModCluster + (512 / 2);
+        if (SectorEnd > End)
+            SectorEnd = End;
+
+        FatLinkRun16(FModTab + Cluster - FModCluster, Cluster + 1, SectorEnd - Cluster);
+        Cluster = SectorEnd;
+
+        FWrite = true;
+    }
+
+    if (Count)
+    {
+        SetupMod(Cluster - 1);
+        FModTab[Cluster - 1 - FModCluster] = 0xFFFF;
+        FWrite = true;
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable16::FreeRun
+#
+#   Purpose....: Free consecutive clusters. Each table sector is set up
+#                and cleared once, and the bitmap and free count are
+#                updated for the whole run
+#
+#   In params..: Cluster        First cluster
+#                Count          Number of clusters
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable16::FreeRun(unsigned int Cluster, unsigned int Count)
+{
+    unsigned int Start = Cluster;
+    unsigned int End = Cluster + Count;
+    unsigned int SectorEnd;
+
+    while (Cluster < End)
+    {
+        SetupMod(Cluster);
+
+        SectorEnd = FModCluster + (512 / 2);
+        if (SectorEnd > End)
+            SectorEnd = End;
+
+        memset(FModTab + Cluster - FModCluster, 0, (SectorEnd - Cluster) * 2);
+        Cluster = SectorEnd;
+
+        FWrite = true;
+    }
+
+    if (Start < FScanCluster)
+    {
+        if (End > FScanCluster)
+            End = FScanCluster;
+
+        FBitmap.SetFreeRun(Start, End - Start);
+        FFreeClusters += End - Start;
+    }
 }
 
 /*##########################################################################
@@ -541,6 +849,48 @@ void TFatTable16::FreeCluster(unsigned int Cluster)
 ##########################################################################*/
 void TFatTable16::Complete()
 {
-    if (FModReq)
-        ClearMod();
+    ClearMod();
+    FModSet.Flush();
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable16::IsClean
+#
+#   Purpose....: Check clean shutdown flag in FAT[1]
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFatTable16::IsClean()
+{
+    if (GetClusterLink(1) & 0x8000)
+        return true;
+    else
+        return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFatTable16::SetClean
+#
+#   Purpose....: Set or clear clean shutdown flag in FAT[1]
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFatTable16::SetClean(bool Clean)
+{
+    SetupMod(1);
+
+    if (Clean)
+        FModTab[1 - FModCluster] |= 0x8000;
+    else
+        FModTab[1 - FModCluster] &= ~0x8000;
+
+    FWrite = true;
 }
@@ -45,29 +45,30 @@ public:
     virtual unsigned int FormatClusters();
 
     virtual unsigned int AllocateCluster();
+    virtual unsigned int AllocateRun(unsigned int Count, unsigned int *Size);
+    virtual unsigned int GetRun(unsigned int Cluster, unsigned int *Count);
+    virtual unsigned int GetLinks(unsigned int Cluster, unsigned int Count, unsigned int *Links);
+    virtual void LinkRun(unsigned int Cluster, unsigned int Count);
+    virtual void FreeRun(unsigned int Cluster, unsigned int Count);
     virtual bool ReserveCluster(unsigned int Cluster);
     virtual void LinkCluster(unsigned int Cluster, unsigned int Link);
     virtual void LinkCluster(unsigned int Cluster);
     virtual void FreeCluster(unsigned int Cluster);
     virtual void Complete();
 
+    virtual bool IsClean();
+    virtual void SetClean(bool Clean);
+
     void Setup(int SectorsPerCluster, long long StartSector, int FatSectors, unsigned int Clusters);
-    void SetCacheSize(int size);
 
 protected:
     unsigned int FormatBlock(long long Sector, unsigned int Clusters);
-    unsigned int GetFreeInBlock(long long Sector, unsigned int Clusters);
+    unsigned int AllocateTableRun(unsigned int Count, unsigned int *Size);
+    virtual unsigned int CountFree(const char *Data, unsigned int Cluster, unsigned int Clusters);
 
     void ClearMod();
-    void ClearCache();
-
-    void SetupCache(unsigned int Cluster);
     void SetupMod(unsigned int Cluster);
 
-    TPartReqEntry *FReqEntry;
-    unsigned int *FTab;
-
-    TPartReqEntry *FModReq;
     unsigned int FModCluster;
     unsigned int *FModTab;
 };
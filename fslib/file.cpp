@@ -58,6 +58,7 @@ TFileReq::TFileReq(int handle, int index, int req)
     MaxSectors = 0;
     SectorCount = 0;
     SectorArr = 0;
+    ArrSize = 0;
 
     File = handle;
     Index = index;
@@ -92,7 +93,8 @@ TFileReq::~TFileReq()
 #
 #   Name       : TFileReq::InitArray
 #
-#   Purpose....: Init array
+#   Purpose....: Init array. The previous array is reused if it is
+#                large enough
 #
 #   In params..: *
 #   Out params.: *
@@ -101,19 +103,24 @@ TFileReq::~TFileReq()
 ##########################################################################*/
 void TFileReq::InitArray(int sectors)
 {
-    if (SectorArr)
-        delete SectorArr;
+    if (sectors > ArrSize)
+    {
+        if (SectorArr)
+            delete SectorArr;
+
+        ArrSize = sectors;
+        SectorArr = new long long[sectors];
+    }
 
     MaxSectors = sectors;
     SectorCount = 0;
-    SectorArr = new long long[sectors];
 }
 
 /*##########################################################################
 #
 #   Name       : TFileReq::FreeArray
 #
-#   Purpose....: Free array
+#   Purpose....: Free array. Small arrays are kept for the next request
 #
 #   In params..: *
 #   Out params.: *
@@ -122,10 +129,12 @@ void TFileReq::InitArray(int sectors)
 ##########################################################################*/
 void TFileReq::FreeArray()
 {
-    if (SectorArr)
+    if (ArrSize > FILE_REQ_KEEP_SECTORS)
+    {
         delete SectorArr;
-
-    SectorArr = 0;
+        SectorArr = 0;
+        ArrSize = 0;
+    }
 }
 
 /*##########################################################################
@@ -148,6 +157,28 @@ void TFileReq::AddSector(long long sector)
     }
 }
 
+/*##########################################################################
+#
+#   Name       : TFileReq::AddSectors
+#
+#   Purpose....: Add contiguous sectors to buffer
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFileReq::AddSectors(long long sector, int count)
+{
+    while (count && SectorCount < MaxSectors)
+    {
+        SectorArr[SectorCount] = sector;
+        SectorCount++;
+        sector++;
+        count--;
+    }
+}
+
 /*##########################################################################
 #
 #   Name       : TFileReq::SetPos
@@ -337,6 +368,16 @@ TFile::TFile(TDir *pd, int pi, int bps, int os)
 
     FFreeList = 0;
 
+    FRestStart = 0;
+    FRestSectors = 0;
+
+    FLastReadPos = 0;
+    FLastReadEnd = 0;
+    FReadStride = 0;
+    FAccessPattern = FILE_ACCESS_SEQUENTIAL;
+    FReadAhead = 0;
+    FMaxReadAhead = 0;
+
     FParent->UnlockEntry(entry);
 
     SetAccessTime(RdosGetLongTime());
@@ -707,11 +748,96 @@ long long TFile::GetSector(long long pos)
     return 0;
 }
 
+/*##########################################################################
+#
+#   Name       : TFile::GetExtent
+#
+#   Purpose....: Default get extent. Returns the sector of pos, and the
+#                range of file sectors that are contiguous on disc with it
+#
+#   In params..: pos            File sector
+#   Out params.: start          First file sector of extent
+#                count          Sectors in extent
+#   Returns....: Disc sector of pos
+#
+##########################################################################*/
+long long TFile::GetExtent(long long pos, long long *start, long long *count)
+{
+    *start = pos;
+    *count = 1;
+    return GetSector(pos);
+}
+
+/*##########################################################################
+#
+#   Name       : TFile::MapReq
+#
+#   Purpose....: Map FCurrStart and FCurrSectors into req, one extent at
+#                a time. Extents that start on a page boundary are
+#                gathered into the same req. Other extents end the req if
+#                it already holds FCurrPos, and the part left is kept in
+#                FRestStart and FRestSectors. Otherwise the req restarts
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFile::MapReq(TFileReq *req)
+{
+    long long pos = FCurrStart;
+    long long end = FCurrStart + FCurrSectors;
+    long long prev = 0;
+    long long curr;
+    long long start;
+    long long count;
+    bool HasPos = false;
+    int size;
+
+    FRestSectors = 0;
+
+    while (pos < end)
+    {
+        curr = GetExtent(pos, &start, &count);
+
+        size = (int)(start + count - pos);
+        if (size > end - pos)
+            size = (int)(end - pos);
+
+        if (req->SectorCount && curr != prev + 1)
+        {
+            if ((curr + FOffsetSector) % FSectorsPerPage)
+            {
+                if (HasPos)
+                {
+                    FRestStart = pos;
+                    FRestSectors = (int)(end - pos);
+                    break;
+                }
+                else
+                {
+                    FCurrStart = pos;
+                    req->SectorCount = 0;
+                }
+            }
+        }
+
+        if (FCurrPos >= pos && FCurrPos < pos + size)
+            HasPos = true;
+
+        req->AddSectors(curr, size);
+
+        prev = curr + size - 1;
+        pos += size;
+    }
+}
+
 /*##########################################################################
 #
 #   Name       : TFile::SetRead
 #
-#   Purpose....: Set read params
+#   Purpose....: Set read params. Start and end are moved to page
+#                boundaries within the extents that hold them
 #
 #   In params..: *
 #   Out params.: *
@@ -725,7 +851,9 @@ void TFile::SetRead(long long StartSector, int Sectors)
     long long end;
     long long temp;
     long long sect;
-    long long exp;
+    long long ext;
+    long long back;
+    long long forw;
     int i;
     TFileReq *FileReq;
 
@@ -740,26 +868,13 @@ void TFile::SetRead(long long StartSector, int Sectors)
 
     start = StartSector;
 
-    sect = FOffsetSector + GetSector(start);
-    exp = sect - 1;
-    while (sect % FSectorsPerPage)
-    {
-        if (start)
-        {
-            sect = FOffsetSector + GetSector(start - 1);
+    sect = FOffsetSector + GetExtent(start, &ext, &temp);
+    back = sect % FSectorsPerPage;
+    if (back > start - ext)
+        back = start - ext;
 
-            if (sect == exp)
-            {
-                exp = sect - 1;
-                start--;
-                Sectors++;
-            }
-            else
-                break;
-        }
-        else
-            break;
-    }
+    start -= back;
+    Sectors += (int)back;
 
     end = StartSector + Sectors - 1;
 
@@ -769,25 +884,14 @@ void TFile::SetRead(long long StartSector, int Sectors)
     if (end > Info->SectorCount)
         end = Info->SectorCount - 1;
 
-    sect = FOffsetSector + GetSector(end + 1);
-    exp = sect + 1;
-    while (sect % FSectorsPerPage)
-    {
-        if (end < Info->SectorCount - 1)
-        {
-            sect = FOffsetSector + GetSector(end + 2);
-
-            if (sect == exp)
-            {
-                exp = sect + 1;
-                end++;
-            }
-            else
-                break;
-        }
-        else
-            break;
-    }
+    sect = FOffsetSector + GetExtent(end + 1, &ext, &temp);
+    forw = (FSectorsPerPage - sect % FSectorsPerPage) % FSectorsPerPage;
+    if (forw > ext + temp - 1 - (end + 1))
+        forw = ext + temp - 1 - (end + 1);
+    if (forw > Info->SectorCount - 1 - end)
+        forw = Info->SectorCount - 1 - end;
+    if (forw > 0)
+        end += forw;
 
     count = end - start + 1;
 
@@ -889,11 +993,102 @@ void TFile::SetWrite(long long StartSector, int Sectors)
     FCurrSectors = (int)count;
 }
 
+/*##########################################################################
+#
+#   Name       : TFile::SetMaxReadAhead
+#
+#   Purpose....: Set largest readahead window
+#
+#   In params..: Sectors        Window in sectors, 0 disables readahead
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFile::SetMaxReadAhead(int Sectors)
+{
+    if (Sectors < 0)
+        Sectors = 0;
+
+    FMaxReadAhead = Sectors;
+
+    if (FReadAhead > FMaxReadAhead)
+        FReadAhead = FMaxReadAhead;
+}
+
+/*##########################################################################
+#
+#   Name       : TFile::UpdateReadAhead
+#
+#   Purpose....: Classify access pattern from the previous read, and
+#                update readahead window. A read that starts within or
+#                right after the previous read is sequential, and doubles
+#                the window. A read with the same distance as the previous
+#                one is strided, and keeps the window. Other reads are
+#                random, and halve the window
+#
+#   In params..: StartSector    First sector of read
+#                Sectors        Sectors in read
+#   Out params.: *
+#   Returns....: Sectors to read ahead
+#
+##########################################################################*/
+int TFile::UpdateReadAhead(long long StartSector, int Sectors)
+{
+    long long stride = StartSector - FLastReadPos;
+    int ahead;
+
+    if (StartSector >= FLastReadPos && StartSector <= FLastReadEnd)
+    {
+        FAccessPattern = FILE_ACCESS_SEQUENTIAL;
+
+        if (FReadAhead)
+            FReadAhead = 2 * FReadAhead;
+        else
+        {
+            if (Sectors > FSectorsPerPage)
+                FReadAhead = Sectors;
+            else
+                FReadAhead = FSectorsPerPage;
+        }
+    }
+    else
+    {
+        if (stride && stride == FReadStride)
+            FAccessPattern = FILE_ACCESS_STRIDED;
+        else
+        {
+            FAccessPattern = FILE_ACCESS_RANDOM;
+            FReadAhead = FReadAhead / 2;
+
+            if (FReadAhead < FSectorsPerPage)
+                FReadAhead = 0;
+        }
+    }
+
+    if (FReadAhead > FMaxReadAhead)
+        FReadAhead = FMaxReadAhead;
+
+    if (FAccessPattern == FILE_ACCESS_STRIDED)
+        ahead = 0;
+    else
+        ahead = FReadAhead;
+
+    FReadStride = stride;
+    FLastReadPos = StartSector;
+
+    if (StartSector + Sectors > FLastReadEnd)
+        FLastReadEnd = StartSector + Sectors;
+
+    return ahead;
+}
+
 /*##########################################################################
 #
 #   Name       : TFile::HandleRead
 #
-#   Purpose....: Handle read file
+#   Purpose....: Handle read file. Sequential reads are extended by the
+#                readahead window, up to the end of the extent after the
+#                read
 #
 #   In params..: *
 #   Out params.: *
@@ -902,20 +1097,37 @@ void TFile::SetWrite(long long StartSector, int Sectors)
 ##########################################################################*/
 TFileReq *TFile::HandleRead(long long pos, int size)
 {
-    int sector;
-    long long prev;
-    long long curr;
-    int offset;
-    bool HasPos = false;
     TFileReq *FileReq = 0;
     char str[80];
+    int sectors;
+    int ahead;
+    long long end;
+    long long ext;
+    long long count;
 
     if (!FParent)
         return 0;
 
     FCurrPos = pos / FBytesPerSector;
+    sectors = size / FBytesPerSector;
+
+    ahead = UpdateReadAhead(FCurrPos, sectors);
+    end = FCurrPos + sectors;
 
-    SetRead(FCurrPos, size / FBytesPerSector);
+    if (ahead && end < Info->SectorCount)
+    {
+        GetExtent(end, &ext, &count);
+
+        if (ahead > ext + count - end)
+            ahead = (int)(ext + count - end);
+
+        if (ahead > Info->SectorCount - end)
+            ahead = (int)(Info->SectorCount - end);
+    }
+    else
+        ahead = 0;
+
+    SetRead(FCurrPos, sectors + ahead);
 
     if (FCurrSectors > 0)
         FileReq = AllocateReq();
@@ -930,40 +1142,13 @@ TFileReq *TFile::HandleRead(long long pos, int size)
 
         FileReq->InitArray(FCurrSectors);
 
-        for (sector = 0; sector < FCurrSectors; sector++)
-        {
-            if (FCurrStart + sector == FCurrPos)
-                HasPos = true;
-
-            curr = GetSector(FCurrStart + sector);
-
-            if (sector)
-            {
-                prev++;
-                offset = (int)((curr + FOffsetSector) % FSectorsPerPage);
-
-                if (offset)
-                {
-                    if (prev != curr)
-                    {
-                        if (HasPos)
-                            break;
-                        else
-                        {
-                            FCurrStart += sector;
-                            FCurrSectors -= sector;
-                            sector = 0;
-                            FileReq->SectorCount = 0;
-                        }
-                    }
-                }
-            }
-            prev = curr;
-            FileReq->AddSector(curr);
-        }
+        MapReq(FileReq);
 
         FCurrSectors = FileReq->SectorCount;
 
+        if (FCurrStart + FCurrSectors > FLastReadEnd)
+            FLastReadEnd = FCurrStart + FCurrSectors;
+
         if (FileReq->SectorCount)
             FileReq->SetPos(FBytesPerSector, FCurrStart);
         else
@@ -1179,11 +1364,6 @@ void TFile::HandleMapReq(int req)
 ##########################################################################*/
 TFileReq *TFile::HandleGrowReq(long long req)
 {
-    int sector;
-    long long prev;
-    long long curr;
-    int offset;
-    bool HasPos = false;
     TFileReq *FileReq = 0;
     char str[80];
     long long pos;
@@ -1227,37 +1407,7 @@ TFileReq *TFile::HandleGrowReq(long long req)
 
         FileReq->InitArray(FCurrSectors);
 
-        for (sector = 0; sector < FCurrSectors; sector++)
-        {
-            if (FCurrStart + sector == FCurrPos)
-                HasPos = true;
-
-            curr = GetSector(FCurrStart + sector);
-
-            if (sector)
-            {
-                prev++;
-                offset = (int)((curr + FOffsetSector) % FSectorsPerPage);
-
-                if (offset)
-                {
-                    if (prev != curr)
-                    {
-                        if (HasPos)
-                            break;
-                        else
-                        {
-                            FCurrStart += sector;
-                            FCurrSectors -= sector;
-                            sector = 0;
-                            FileReq->SectorCount = 0;
-                        }
-                    }
-                }
-            }
-            prev = curr;
-            FileReq->AddSector(curr);
-        }
+        MapReq(FileReq);
 
         FCurrSectors = FileReq->SectorCount;
 
@@ -1293,6 +1443,65 @@ TFileReq *TFile::HandleGrowReq(long long req)
     return FileReq;
 }
 
+/*##########################################################################
+#
+#   Name       : TFile::HandleRestReq
+#
+#   Purpose....: Handle part of the last read or grow req that did not
+#                fit because of an extent that is not page aligned
+#
+#   In params..: write          true for grow req
+#   Out params.: *
+#   Returns....: Req for rest, or 0 when done
+#
+##########################################################################*/
+TFileReq *TFile::HandleRestReq(bool write)
+{
+    TFileReq *FileReq;
+    int sectors = FRestSectors;
+
+    if (!FParent || sectors <= 0)
+        return 0;
+
+    FCurrPos = FRestStart;
+    FRestSectors = 0;
+
+    if (write)
+        SetWrite(FCurrPos, sectors);
+    else
+        SetRead(FCurrPos, sectors);
+
+    if (FCurrSectors > 0)
+        FileReq = AllocateReq();
+    else
+        FileReq = 0;
+
+    if (FileReq)
+    {
+        FileReq->InitArray(FCurrSectors);
+
+        MapReq(FileReq);
+
+        FCurrSectors = FileReq->SectorCount;
+
+        if (!write && FCurrStart + FCurrSectors > FLastReadEnd)
+            FLastReadEnd = FCurrStart + FCurrSectors;
+
+        if (FileReq->SectorCount)
+        {
+            FileReq->SetPos(FBytesPerSector, FCurrStart);
+            AddActive(FileReq);
+        }
+        else
+        {
+            FreeReq(FileReq);
+            FileReq = 0;
+        }
+    }
+
+    return FileReq;
+}
+
 /*##########################################################################
 #
 #   Name       : TFile::HandleSizeReq
@@ -1315,6 +1524,28 @@ void TFile::HandleSizeReq(long long size)
     SetSize(size);
 }
 
+/*##########################################################################
+#
+#   Name       : TFile::HandleReserveReq
+#
+#   Purpose....: Handle reserve req
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFile::HandleReserveReq(long long size)
+{
+    char str[80];
+
+    sprintf(str, "Reserve %d.%lld\r\n", Index, size);
+//    RdosWriteFile(FileHandle, str, strlen(str));
+//    printf(str);
+
+    Reserve(size);
+}
+
 /*##########################################################################
 #
 #   Name       : TFile::HandleDeleteReq
@@ -1338,6 +1569,26 @@ void TFile::HandleDeleteReq()
     DeleteDirEntry();
 }
 
+/*##########################################################################
+#
+#   Name       : TFile::Reserve
+#
+#   Purpose....: Reserve disc space for file. The file size and the
+#                mapped disc size are not changed
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFile::Reserve(long long size)
+{
+    if (!FParent)
+        return false;
+
+    return ReserveDisc(size);
+}
+
 /*##########################################################################
 #
 #   Name       : TFile::SetSize
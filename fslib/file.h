@@ -38,6 +38,12 @@
 #include "dir.h"
 #include "sig.h"
 
+#define FILE_REQ_KEEP_SECTORS   256
+
+#define FILE_ACCESS_RANDOM      0
+#define FILE_ACCESS_SEQUENTIAL  1
+#define FILE_ACCESS_STRIDED     2
+
 class TFileReq
 {
 public:
@@ -47,6 +53,7 @@ public:
     void InitArray(int sectors);
     void FreeArray();
     void AddSector(long long sector);
+    void AddSectors(long long sector, int count);
 
     void SetPos(int BytesPerSector, long long pos);
     void StartRead();
@@ -68,6 +75,7 @@ public:
 protected:
     bool Enabled;
     int MaxSectors;
+    int ArrSize;
     long long *SectorArr;
 };
 
@@ -91,7 +99,9 @@ public:
     void SetAccessTime(long long time);
     void SetModifyTime(long long time);
     bool SetSize(long long Size);
+    bool Reserve(long long Size);
     long long GetDiscSize();
+    void SetMaxReadAhead(int Sectors);
 
     virtual bool GrowDisc(long long Size) = 0;
 
@@ -105,13 +115,20 @@ protected:
     virtual void HandleMapReq(int index);
     virtual void HandleFreeReq(int index);
     virtual TFileReq *HandleGrowReq(long long size);
+    virtual TFileReq *HandleRestReq(bool write);
     virtual void HandleSizeReq(long long size);
     virtual void HandleDeleteReq();
+    virtual void HandleReserveReq(long long size);
     virtual bool SetDiscSize(long long Size) = 0;
+    virtual bool ReserveDisc(long long Size) = 0;
 
     virtual void SetRead(long long RelSector, int Sectors);
     virtual void SetWrite(long long RelSector, int Sectors);
     virtual long long GetSector(long long pos);
+    virtual long long GetExtent(long long pos, long long *start, long long *count);
+
+    void MapReq(TFileReq *req);
+    int UpdateReadAhead(long long StartSector, int Sectors);
 
     bool IsDirEntryUnlinked();
     void UnlinkDirEntry();
@@ -148,6 +165,16 @@ protected:
     long long FCurrStart;
     int FCurrSectors;
 
+    long long FRestStart;
+    int FRestSectors;
+
+    long long FLastReadPos;
+    long long FLastReadEnd;
+    long long FReadStride;
+    int FAccessPattern;
+    int FReadAhead;
+    int FMaxReadAhead;
+
     int FBytesPerSector;
     int FSectorsPerPage;
     int FOffsetSector;
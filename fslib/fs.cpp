@@ -47,6 +47,12 @@
 #define REQ_GROW       7
 #define REQ_UPDATE     8
 #define REQ_DELETE     9
+#define REQ_RESERVE    10
+
+void MemFence();
+#pragma aux MemFence = \
+    "lock or dword ptr [esp],0" \
+    __modify __exact []
 
 /*##########################################################################
 #
@@ -64,6 +70,24 @@ static void ThreadStartup(void *ptr)
     ((TFs *)ptr)->Execute();
 }
 
+/*##########################################################################
+#
+#   Name       : WorkerStartup
+#
+#   Purpose....: Startup procedure for worker thread
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+static void WorkerStartup(void *ptr)
+{
+    TFsWorker *Worker = (TFsWorker *)ptr;
+
+    Worker->Fs->ExecuteWorker(Worker);
+}
+
 /*##########################################################################
 #
 #   Name       : TParser::TParser
@@ -407,6 +431,151 @@ void TParser::Advance()
     }
 }
 
+/*##########################################################################
+#
+#   Name       : TFsWorker::TFsWorker
+#
+#   Purpose....: I/O worker constructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFsWorker::TFsWorker(TFs *fs, int id)
+{
+    Fs = fs;
+    Id = id;
+    Active = false;
+
+    FHead = 0;
+    FTail = 0;
+    FFull = false;
+    FWake = false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFsWorker::~TFsWorker
+#
+#   Purpose....: I/O worker destructor
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TFsWorker::~TFsWorker()
+{
+}
+
+/*##########################################################################
+#
+#   Name       : TFsWorker::Put
+#
+#   Purpose....: Put a copy of a queue entry last in worker queue. Only
+#                the dispatcher puts entries. The worker is not signalled
+#                until Wake is called. The slot is stored before head
+#                moves, so the worker never sees a partial entry. When
+#                the queue is full, FFull asks Remove to signal Space
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: false if the queue is full
+#
+##########################################################################*/
+bool TFsWorker::Put(TFile *file, struct TFsQueueEntry *entry)
+{
+    int next = (FHead + 1) % FS_WORKER_ENTRIES;
+
+    if (next == FTail)
+    {
+        FFull = true;
+        MemFence();
+
+        if (next == FTail)
+            return false;
+
+        FFull = false;
+    }
+
+    FArr[FHead] = *entry;
+    FFileArr[FHead] = file;
+    MemFence();
+    FHead = next;
+    FWake = true;
+
+    return true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFsWorker::Get
+#
+#   Purpose....: Get first entry in worker queue
+#
+#   In params..: *
+#   Out params.: file           File of entry
+#   Returns....: Entry, or 0 if the queue is empty
+#
+##########################################################################*/
+struct TFsQueueEntry *TFsWorker::Get(TFile **file)
+{
+    if (FTail == FHead)
+        return 0;
+    else
+    {
+        MemFence();
+        *file = FFileArr[FTail];
+        return &FArr[FTail];
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFsWorker::Remove
+#
+#   Purpose....: Remove first entry in worker queue, and signal Space
+#                if the dispatcher found the queue full
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFsWorker::Remove()
+{
+    MemFence();
+    FTail = (FTail + 1) % FS_WORKER_ENTRIES;
+    MemFence();
+
+    if (FFull)
+    {
+        FFull = false;
+        Space.Signal();
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFsWorker::Wake
+#
+#   Purpose....: Signal worker if entries were put since last wake
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFsWorker::Wake()
+{
+    if (FWake)
+    {
+        FWake = false;
+        Signal.Signal();
+    }
+}
+
 /*##########################################################################
 #
 #   Name       : TFs::TFs
@@ -419,6 +588,7 @@ void TParser::Advance()
 #
 ##########################################################################*/
 TFs::TFs(TPartServer *server)
+  : FPendSection("FS Pend")
 {
     int i;
 
@@ -433,6 +603,9 @@ TFs::TFs(TPartServer *server)
     FOffsetSector = (int)(FStartSector % FSectorsPerPage);
 
     FQueueArr = 0;
+    FQueueSize = FS_MIN_QUEUE_ENTRIES;
+    FStaleCount = 0;
+    FReadAhead = 0;
     FServerActive = false;
 
     FCurrDirCount = 0;
@@ -455,6 +628,11 @@ TFs::TFs(TPartServer *server)
 
     for (i = 0; i < FMaxPendCount; i++)
         FPendArr[i] = 0;
+
+    for (i = 0; i < FS_MAX_WORKERS; i++)
+        FWorkerArr[i] = 0;
+
+    FWorkerCount = 1;
 }
 
 /*##########################################################################
@@ -483,6 +661,10 @@ TFs::~TFs()
             delete FFileArr[i];
 
     delete FFileArr;
+
+    for (i = 0; i < FS_MAX_WORKERS; i++)
+        if (FWorkerArr[i])
+            delete FWorkerArr[i];
 }
 
 /*##########################################################################
@@ -514,6 +696,8 @@ TPartServer *TFs::GetServer()
 ##########################################################################*/
 void TFs::Stop()
 {
+    int i;
+
     FStopped = true;
 
     if (FServerActive)
@@ -524,6 +708,17 @@ void TFs::Stop()
             RdosWaitMilli(50);
     }
 
+    for (i = 0; i < FS_MAX_WORKERS; i++)
+    {
+        if (FWorkerArr[i])
+        {
+            FWorkerArr[i]->Signal.Signal();
+
+            while (FWorkerArr[i]->Active)
+                RdosWaitMilli(50);
+        }
+    }
+
     if (FQueueArr)
         RdosFreeMem(FQueueArr);
 
@@ -546,6 +741,156 @@ int TFs::Format(long long *Start, long long *Size)
     return 0;
 }
 
+/*##########################################################################
+#
+#   Name       : TFs::Idle
+#
+#   Purpose....: Do background work for files of a worker when its
+#                queue is empty
+#
+#   In params..: Worker         Worker id
+#   Out params.: *
+#   Returns....: true if more work is pending
+#
+##########################################################################*/
+bool TFs::Idle(int Worker)
+{
+    return false;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::SetWorkers
+#
+#   Purpose....: Set number of I/O workers. Must be called before the
+#                I/O server starts
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::SetWorkers(int Count)
+{
+    if (Count < 1)
+        Count = 1;
+
+    if (Count > FS_MAX_WORKERS)
+        Count = FS_MAX_WORKERS;
+
+    if (!FServerActive)
+        FWorkerCount = Count;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::GetWorkers
+#
+#   Purpose....: Get number of I/O workers
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFs::GetWorkers()
+{
+    return FWorkerCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::GetWorker
+#
+#   Purpose....: Get worker that handles file. All queue entries of a
+#                file go to the same worker, which keeps them in order
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFs::GetWorker(TFile *file)
+{
+    return file->Index % FWorkerCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::SetQueueSize
+#
+#   Purpose....: Set number of entries in I/O queue. The size is rounded
+#                up to a power of two. Must be called before the I/O server
+#                starts
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::SetQueueSize(int Entries)
+{
+    int size = FS_MIN_QUEUE_ENTRIES;
+
+    while (size < Entries && size < FS_MAX_QUEUE_ENTRIES)
+        size = 2 * size;
+
+    if (!FQueueArr)
+        FQueueSize = size;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::GetQueueSize
+#
+#   Purpose....: Get number of entries in I/O queue
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFs::GetQueueSize()
+{
+    return FQueueSize;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::GetStaleCount
+#
+#   Purpose....: Get number of skipped queue entries for unknown files
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+int TFs::GetStaleCount()
+{
+    return FStaleCount;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::SetReadAhead
+#
+#   Purpose....: Set largest readahead window for files opened after
+#                the call
+#
+#   In params..: Kb             Window in KB, 0 disables readahead
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::SetReadAhead(int Kb)
+{
+    if (Kb < 0)
+        Kb = 0;
+
+    FReadAhead = (int)((long long)Kb * 1024 / FBytesPerSector);
+}
+
 /*##########################################################################
 #
 #   Name       : TFs::GrowDir
@@ -685,6 +1030,7 @@ void TFs::Add(TFile *file)
 {
     int handle;
 
+    file->SetMaxReadAhead(FReadAhead);
     handle = file->Setup(FServer->GetHandle());
 
     if (handle)
@@ -1058,6 +1404,30 @@ void TFs::GrowPend()
     FMaxPendCount = Size;
 }
 
+/*##########################################################################
+#
+#   Name       : TFs::AddPend
+#
+#   Purpose....: Add req to pend array
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::AddPend(TFileReq *req)
+{
+    FPendSection.Enter();
+
+    if (FCurrPendCount == FMaxPendCount)
+        GrowPend();
+
+    FPendArr[FCurrPendCount] = req;
+    FCurrPendCount++;
+
+    FPendSection.Leave();
+}
+
 /*##########################################################################
 #
 #   Name       : TFs::OpenFile
@@ -1311,6 +1681,27 @@ bool TFs::SetFileSize(int handle, long long size)
         return false;
 }
 
+/*##########################################################################
+#
+#   Name       : TFs::ReserveFileSpace
+#
+#   Purpose....: Reserve disc space for file without changing its size
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TFs::ReserveFileSpace(int handle, long long size)
+{
+    TFile *file = GetFile(handle);
+
+    if (file)
+        return file->Reserve(size);
+    else
+        return false;
+}
+
 /*##########################################################################
 #
 #   Name       : TFs::DerefFile
@@ -1385,9 +1776,23 @@ void TFs::StartServer()
     int Handle = FServer->GetHandle();
     int Disc = ServGetVfsDisc(Handle);
     int Part = ServGetVfsPart(Handle);
+    int i;
 
     if (!FStopped)
     {
+        if (FWorkerCount > 1)
+        {
+            for (i = 0; i < FWorkerCount; i++)
+            {
+                if (!FWorkerArr[i])
+                    FWorkerArr[i] = new TFsWorker(this, i);
+
+                FWorkerArr[i]->Active = true;
+                sprintf(ThreadName, "File IO %02hX.%02hX.%d", Disc, Part, i);
+                RdosCreateThread(WorkerStartup, ThreadName, FWorkerArr[i], 0x2000);
+            }
+        }
+
         sprintf(ThreadName, "File IO %02hX.%02hX", Disc, Part);
         RdosCreateThread(ThreadStartup, ThreadName, this, 0x2000);
     }
@@ -1397,7 +1802,8 @@ void TFs::StartServer()
 #
 #   Name       : TFs::HandleRead
 #
-#   Purpose....: Handle read file
+#   Purpose....: Handle read file. A range that needs several reqs is
+#                started in one pass
 #
 #   In params..: *
 #   Out params.: *
@@ -1411,14 +1817,12 @@ void TFs::HandleRead(TFile *file, long long pos, int size)
 
     req = file->HandleRead(pos, size);
 
-    if (req)
+    while (req)
     {
-        if (FCurrPendCount == FMaxPendCount)
-            GrowPend();
-
-        FPendArr[FCurrPendCount] = req;
-        FCurrPendCount++;
+        AddPend(req);
         req->StartRead();
+
+        req = file->HandleRestReq(false);
     }
 }
 
@@ -1456,6 +1860,8 @@ void TFs::HandleCompletedReq(TFile *file, int req)
     int index = file->Index;
     TFileReq *fr = 0;
 
+    FPendSection.Enter();
+
     for (i = 0; i < FCurrPendCount; i++)
     {
         if (index == FPendArr[i]->Index && req == FPendArr[i]->Req)
@@ -1472,6 +1878,8 @@ void TFs::HandleCompletedReq(TFile *file, int req)
         }
     }
 
+    FPendSection.Leave();
+
     file->HandleCompletedReq(req);
 }
 
@@ -1509,14 +1917,12 @@ void TFs::HandleGrowReq(TFile *file, long long size)
 
     req = file->HandleGrowReq(size);
 
-    if (req)
+    while (req)
     {
-        if (FCurrPendCount == FMaxPendCount)
-            GrowPend();
-
-        FPendArr[FCurrPendCount] = req;
-        FCurrPendCount++;
+        AddPend(req);
         req->StartWrite();
+
+        req = file->HandleRestReq(true);
     }
 }
 
@@ -1570,6 +1976,23 @@ void TFs::HandleDeleteReq(TFile *file, int thread)
     ServSignal(thread);
 }
 
+/*##########################################################################
+#
+#   Name       : TFs::HandleReserveReq
+#
+#   Purpose....: Handle reserve req
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::HandleReserveReq(TFile *file, long long size, int thread)
+{
+    file->HandleReserveReq(size);
+    ServSignal(thread);
+}
+
 /*##########################################################################
 #
 #   Name       : TFs::HandleQueue
@@ -1617,6 +2040,10 @@ void TFs::HandleQueue(TFile *file, struct TFsQueueEntry *entry)
             HandleDeleteReq(file, entry->Par32);
             break;
 
+        case REQ_RESERVE:
+            HandleReserveReq(file, entry->Par64, entry->Par32);
+            break;
+
         case REQ_CLOSE:
             file->Close();
             break;
@@ -1628,7 +2055,10 @@ void TFs::HandleQueue(TFile *file, struct TFsQueueEntry *entry)
 #
 #   Name       : TFs::Execute
 #
-#   Purpose....: Execute
+#   Purpose....: Execute. Takes all ready queue entries in one pass, and
+#                merges adjacent reads and updates of a file. Workers are
+#                woken once per batch. Entries for unknown files are
+#                skipped and counted
 #
 #   In params..: *
 #   Out params.: *
@@ -1639,16 +2069,23 @@ void TFs::Execute()
 {
     int index;
     struct TFsQueueEntry *entry;
+    struct TFsQueueEntry curr;
     int handle;
     TFile *file;
+    int count;
+    int start;
+    int batch = 0;
 
     if (!FQueueArr)
     {
-        FQueueArr = (struct TFsQueueEntry *)RdosAllocateMem(0x1000);
+        FQueueArr = (struct TFsQueueEntry *)RdosAllocateMem(FQueueSize * sizeof(struct TFsQueueEntry));
 
-        for (index = 0; index < 256; index++)
+        for (index = 0; index < FQueueSize; index++)
             FQueueArr[index].Op = 0;
 
+        FQueueArr[0].Par64 = FS_QUEUE_SIGNATURE;
+        FQueueArr[0].Par32 = FQueueSize;
+
         ServStartVfsIoServer(FServer->GetHandle(), FQueueArr);
     }
 
@@ -1670,20 +2107,208 @@ void TFs::Execute()
 
             if (file)
             {
-                HandleQueue(file, entry);
-                entry->Op = 0;
-                index = (index + 1) % 256;
+                curr = *entry;
+                count = 1;
+
+                while (count < FQueueSize - 1 && MergeQueue(&curr, &FQueueArr[(index + count) & (FQueueSize - 1)]))
+                    count++;
+
+                if (FWorkerCount > 1)
+                {
+                    DispatchQueue(file, &curr);
+
+                    batch++;
+                    if (batch >= FS_WAKE_BATCH)
+                    {
+                        WakeWorkers();
+                        batch = 0;
+                    }
+                }
+                else
+                    HandleQueue(file, &curr);
+
+                start = index;
+
+                while (count)
+                {
+                    FQueueArr[index].Op = 0;
+                    index = (index + 1) & (FQueueSize - 1);
+                    count--;
+                }
+
+                SignalQueueSpace(start);
             }
             else
-                break;
+            {
+                if (entry->Op == REQ_SIZE || entry->Op == REQ_DELETE || entry->Op == REQ_RESERVE)
+                    ServSignal(entry->Par32);
+
+                FStaleCount++;
+                entry->Op = 0;
+                SignalQueueSpace(index);
+                index = (index + 1) & (FQueueSize - 1);
+            }
         }
         else
-            ServWaitVfsIoServer(FServer->GetHandle(), index);
+        {
+            if (FWorkerCount > 1)
+            {
+                WakeWorkers();
+                batch = 0;
+            }
+
+            if (FWorkerCount > 1 || !Idle(0))
+                ServWaitVfsIoServer(FServer->GetHandle(), index);
+        }
     }
 
     FServerActive = false;
 }
 
+/*##########################################################################
+#
+#   Name       : TFs::DispatchQueue
+#
+#   Purpose....: Pass queue entry to the worker of the file. Waits if the
+#                worker queue is full
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::DispatchQueue(TFile *file, struct TFsQueueEntry *entry)
+{
+    TFsWorker *Worker = FWorkerArr[GetWorker(file)];
+
+    while (!Worker->Put(file, entry) && !FStopped)
+    {
+        Worker->Wake();
+        Worker->Space.WaitTimeout(250);
+    }
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::WakeWorkers
+#
+#   Purpose....: Wake workers that got entries since last wake
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::WakeWorkers()
+{
+    int i;
+
+    for (i = 0; i < FWorkerCount; i++)
+        if (FWorkerArr[i])
+            FWorkerArr[i]->Wake();
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::SignalQueueSpace
+#
+#   Purpose....: Signal a producer waiting for room after entries from
+#                start were freed. A producer only waits when the ring is
+#                full, and then the entry before start is still in use
+#
+#   In params..: start          First freed entry
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::SignalQueueSpace(int start)
+{
+    if (FQueueArr[(start - 1) & (FQueueSize - 1)].Op)
+        ServWaitVfsIoServer(FServer->GetHandle(), FS_QUEUE_SPACE);
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::MergeQueue
+#
+#   Purpose....: Merge next queue entry into entry. Reads and updates of
+#                the same file that are adjacent or overlap are merged
+#
+#   In params..: entry          Entry to merge into
+#                next           Next entry in queue
+#   Out params.: *
+#   Returns....: true if next was merged
+#
+##########################################################################*/
+bool TFs::MergeQueue(struct TFsQueueEntry *entry, struct TFsQueueEntry *next)
+{
+    long long start;
+    long long end;
+
+    if (next->Op != entry->Op || next->File != entry->File)
+        return false;
+
+    if (entry->Op != REQ_READ && entry->Op != REQ_UPDATE)
+        return false;
+
+    if (next->Par64 > entry->Par64 + entry->Par32)
+        return false;
+
+    if (next->Par64 + next->Par32 < entry->Par64)
+        return false;
+
+    start = entry->Par64;
+    if (next->Par64 < start)
+        start = next->Par64;
+
+    end = entry->Par64 + entry->Par32;
+    if (next->Par64 + next->Par32 > end)
+        end = next->Par64 + next->Par32;
+
+    if (end - start > FS_MERGE_MAX_SIZE)
+        return false;
+
+    entry->Par64 = start;
+    entry->Par32 = (int)(end - start);
+    return true;
+}
+
+/*##########################################################################
+#
+#   Name       : TFs::ExecuteWorker
+#
+#   Purpose....: Execute worker. Handles queue entries of its files in
+#                order, and does background work when idle
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TFs::ExecuteWorker(TFsWorker *Worker)
+{
+    struct TFsQueueEntry *entry;
+    TFile *file;
+
+    while (!FStopped)
+    {
+        entry = Worker->Get(&file);
+
+        if (entry)
+        {
+            HandleQueue(file, entry);
+            Worker->Remove();
+        }
+        else
+        {
+            if (!Idle(Worker->Id))
+                Worker->Signal.WaitTimeout(250);
+        }
+    }
+
+    Worker->Active = false;
+}
+
 /*##########################################################################
 #
 #   Name       : TFs::Run
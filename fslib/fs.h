@@ -35,6 +35,17 @@
 #include "partint.h"
 #include "dir.h"
 #include "file.h"
+#include "sig.h"
+
+#define FS_MAX_WORKERS      8
+#define FS_WORKER_ENTRIES   256
+#define FS_WAKE_BATCH       32
+#define FS_MERGE_MAX_SIZE   0x400000
+
+#define FS_QUEUE_SIGNATURE  0x51534656
+#define FS_QUEUE_SPACE      -1
+#define FS_MIN_QUEUE_ENTRIES    256
+#define FS_MAX_QUEUE_ENTRIES    4096
 
 struct TFsQueueEntry
 {
@@ -44,6 +55,34 @@ struct TFsQueueEntry
     short int Op;
 };
 
+class TFs;
+
+class TFsWorker
+{
+public:
+    TFsWorker(TFs *fs, int id);
+    ~TFsWorker();
+
+    bool Put(TFile *file, struct TFsQueueEntry *entry);
+    struct TFsQueueEntry *Get(TFile **file);
+    void Remove();
+    void Wake();
+
+    TFs *Fs;
+    int Id;
+    bool Active;
+    TSignal Signal;
+    TSignal Space;
+
+protected:
+    struct TFsQueueEntry FArr[FS_WORKER_ENTRIES];
+    TFile *FFileArr[FS_WORKER_ENTRIES];
+    volatile int FHead;
+    volatile int FTail;
+    volatile bool FFull;
+    bool FWake;
+};
+
 class TParser
 {
 public:
@@ -89,6 +128,17 @@ public:
     virtual void Run();
 
     virtual int Format(long long *Start, long long *Count);
+    virtual bool Idle(int Worker);
+
+    void SetWorkers(int Count);
+    int GetWorkers();
+    int GetWorker(TFile *file);
+
+    void SetQueueSize(int Entries);
+    int GetQueueSize();
+    int GetStaleCount();
+
+    void SetReadAhead(int Kb);
 
     virtual long long GetFreeSectors() = 0;
     virtual TDir *CacheRootDir() = 0;
@@ -109,6 +159,7 @@ public:
     int GetFileHandle(int handle);
     int GetFileAttrib(int handle);
     bool SetFileSize(int handle, long long size);
+    bool ReserveFileSpace(int handle, long long size);
     void DerefFile(int handle);
     void CloseFile(int handle);
 
@@ -118,6 +169,7 @@ public:
     void UnlockDirLink(TDir *dir, int index);
 
     void Execute();
+    void ExecuteWorker(TFsWorker *Worker);
 
 protected:
     virtual void HandleRead(TFile *file, long long pos, int size);
@@ -128,7 +180,12 @@ protected:
     virtual void HandleUpdateReq(TFile *file, long long pos, int size);
     virtual void HandleSizeReq(TFile *file, long long size, int thread);
     virtual void HandleDeleteReq(TFile *file, int thread);
+    virtual void HandleReserveReq(TFile *file, long long size, int thread);
     void HandleQueue(TFile *file, struct TFsQueueEntry *entry);
+    void DispatchQueue(TFile *file, struct TFsQueueEntry *entry);
+    bool MergeQueue(struct TFsQueueEntry *entry, struct TFsQueueEntry *next);
+    void WakeWorkers();
+    void SignalQueueSpace(int start);
     void StartServer();
 
     int FileHandleToIndex(int handle);
@@ -142,6 +199,7 @@ protected:
     void Remove(TFile *file);
 
     void GrowPend();
+    void AddPend(TFileReq *req);
 
     TDir *GetStartDir(int rel);
     TFile *GetFile(int handle);
@@ -163,10 +221,17 @@ protected:
 
     bool FServerActive;
     struct TFsQueueEntry *FQueueArr;
+    int FQueueSize;
+    int FStaleCount;
+    int FReadAhead;
 
     TFileReq **FPendArr;
     int FCurrPendCount;
     int FMaxPendCount;
+    TSection FPendSection;
+
+    TFsWorker *FWorkerArr[FS_MAX_WORKERS];
+    int FWorkerCount;
 
     bool FStopped;
     TPartServer *FServer;
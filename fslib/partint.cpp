@@ -380,7 +380,8 @@ void TPartReqEntry::Write()
 #
 #   Name       : TPartReq::TDisReq
 #
-#   Purpose....: Disc req contructor
+#   Purpose....: Disc req contructor. Waits until the partition has a
+#                free req
 #
 #   In params..: *
 #   Out params.: *
@@ -388,6 +389,40 @@ void TPartReqEntry::Write()
 #
 ##########################################################################*/
 TPartReq::TPartReq(TPartServer *server)
+{
+    Init(server, true);
+}
+
+/*##########################################################################
+#
+#   Name       : TPartReq::TPartReq
+#
+#   Purpose....: Disc req contructor
+#
+#   In params..: server         Partition server
+#                wait           Wait until the partition has a free req.
+#                               Otherwise check with IsValid
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+TPartReq::TPartReq(TPartServer *server, bool wait)
+{
+    Init(server, wait);
+}
+
+/*##########################################################################
+#
+#   Name       : TPartReq::Init
+#
+#   Purpose....: Create req
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TPartReq::Init(TPartServer *server, bool wait)
 {
     int i;
 
@@ -395,9 +430,17 @@ TPartReq::TPartReq(TPartServer *server)
     FServer = server;
     FReq = ServCreateVfsReq(handle);
 
-    ServAddWaitForVfsReq(FWaitHandle, FReq, FReq & 0xFF);
+    while (!FReq && wait)
+    {
+        RdosWaitMilli(5);
+        FReq = ServCreateVfsReq(handle);
+    }
 
-    FServer->Add(FReq & 0xFF, this);
+    if (FReq)
+    {
+        ServAddWaitForVfsReq(FWaitHandle, FReq, FReq & 0xFF);
+        FServer->Add(FReq & 0xFF, this);
+    }
 
     for (i = 0; i < MAX_DISC_REQ_ENTRIES; i++)
         FEntryArr[i] = 0;
@@ -418,13 +461,15 @@ TPartReq::~TPartReq()
 {
     int i;
 
-    FServer->Remove(FReq & 0xFF);
+    if (FReq)
+        FServer->Remove(FReq & 0xFF);
 
     for (i = 0; i < MAX_DISC_REQ_ENTRIES; i++)
         if (FEntryArr[i])
             delete FEntryArr[i];
 
-    ServCloseVfsReq(FReq);
+    if (FReq)
+        ServCloseVfsReq(FReq);
 
     RdosCloseWait(FWaitHandle);
 }
@@ -490,6 +535,26 @@ bool TPartReq::IsDone()
     return ServIsVfsReqDone(FReq);
 }
 
+/*##########################################################################
+#
+#   Name       : TPartReq::IsValid
+#
+#   Purpose....: Check if req was created. Creation fails when the
+#                partition has no free reqs
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+bool TPartReq::IsValid()
+{
+    if (FReq)
+        return true;
+    else
+        return false;
+}
+
 /*##########################################################################
 #
 #   Name       : TPartReq::Add
@@ -684,6 +749,22 @@ int TPartServer::Format()
     return 0;
 }
 
+/*##########################################################################
+#
+#   Name       : TPartServer::Write
+#
+#   Purpose....: Write a range of locked sectors
+#
+#   In params..: *
+#   Out params.: *
+#   Returns....: *
+#
+##########################################################################*/
+void TPartServer::Write(long long StartSector, int SectorCount)
+{
+    ServWriteVfsSectors(handle, StartSector, SectorCount);
+}
+
 /*##########################################################################
 #
 #   Name       : TPartServer::Disable
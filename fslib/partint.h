@@ -72,6 +72,7 @@ class TPartReq
 friend class TPartReqEntry;
 public:
     TPartReq(TPartServer *server);
+    TPartReq(TPartServer *server, bool wait);
     ~TPartReq();
 
     int Add(long long StartSector, int SectorCount);
@@ -81,8 +82,10 @@ public:
     int WaitTimeout(int MilliSec);
     int WaitUntil(TDateTime &time);
     bool IsDone();
+    bool IsValid();
 
 protected:
+    void Init(TPartServer *server, bool wait);
     void Add(TPartReqEntry *entry);
     void Remove(TPartReqEntry *entry);
 
@@ -105,6 +108,7 @@ public:
     void Stop();
     void Disable();
     int Format();
+    void Write(long long StartSector, int SectorCount);
 
     long long GetPartStartSector();
     long long GetPartSectors();